@@ -2,180 +2,575 @@
 
 #include <signal.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "command_cache.h"
+#include "event_loop.h"
 #include "job_list.h"
+#include "launch.h"
+#include "server.h"
+#include "startup_trace.h"
+#include "trace.h"
 #include "string_vector.h"
 #include "bash_funcs.h"
 
 #define CMD_LEN 512
 #define PROMPT "@> "
+#define USAGE "Usage: %s [--startup-trace] [-c COMMAND | --server SOCKET_PATH]\n"
 
-int main(int argc, char **argv) {
-    struct sigaction sac;
-    sac.sa_handler = SIG_IGN;
-    if (sigfillset(&sac.sa_mask) == -1) {
-        perror("sigfillset");
-        return 1;
+// Commands handled by eval_command() itself rather than launched as jobs
+static const char *builtins[] = {
+    "pwd", "cd", "exit", "ulimit", "trace", "coproc", "coproc-write", "coproc-read",
+    "coproc-close", "jobs", "fg", "bg", "wait-for", "wait-all",
+};
+
+#define NUM_BUILTINS (sizeof(builtins) / sizeof(builtins[0]))
+
+/*
+ * Check whether a command is one of the shell's builtins
+ * Returns 1 if it is, 0 otherwise
+ */
+static int is_builtin(const char *name) {
+    for (unsigned i = 0; i < NUM_BUILTINS; i++) {
+        if (strcmp(builtins[i], name) == 0) {
+            return 1;
+        }
     }
-    sac.sa_flags = 0;
-    if (sigaction(SIGTTIN, &sac, NULL) == -1 || sigaction(SIGTTOU, &sac, NULL) == -1) {
-        perror("sigaction");
+    return 0;
+}
+
+/*
+ * Print notifications for any background jobs that finished, then the prompt
+ * jobs: The shell's jobs list
+ */
+static void show_prompt(job_list_t *jobs) {
+    reap_background_jobs(jobs, 0);
+    launch_cgroups_cleanup();
+    trace_flush();
+    printf("%s", PROMPT);
+    fflush(stdout);
+}
+
+/*
+ * Create the event loop the first time something needs to wait on it
+ * loop: The shell's event loop, with epoll_fd set to -1 until it is initialized
+ * Returns 0 on success or -1 on error
+ */
+static int ensure_event_loop(event_loop_t *loop) {
+    if (loop->epoll_fd != -1) {
+        return 0;
+    }
+    return event_loop_init(loop);
+}
+
+/*
+ * Convert a job's wait status into the exit status the shell reports for it
+ */
+static int job_exit_status(int status) {
+    if (WIFEXITED(status)) {
+        return WEXITSTATUS(status);
+    } else if (WIFSIGNALED(status)) {
+        return 128 + WTERMSIG(status);
+    } else if (WIFSTOPPED(status)) {
+        return 128 + WSTOPSIG(status);
+    }
+    return 0;
+}
+
+/*
+ * Run a single command line, either as a builtin or as a new job
+ * cmd: The command line, without its trailing '\n'
+ * tokens: Empty string vector to tokenize the command into
+ * jobs: The shell's jobs list
+ * loop: The shell's event loop, used to wait for foreground jobs (initialized on first use)
+ * one_shot: Whether this is the only command the shell will run, as with -c
+ * exit_status: Set to the command's exit status
+ * Returns 0 to keep reading commands, 1 if the shell should exit, or -1 on a fatal error
+ */
+static int eval_command(char *cmd, strvec_t *tokens, job_list_t *jobs, event_loop_t *loop,
+                        int one_shot, int *exit_status) {
+    *exit_status = 0;
+    TRACE(TRACE_PARSE, TRACE_BEGIN);
+    if (tokenize(cmd, tokens) != 0) {
+        TRACE(TRACE_PARSE, TRACE_END);
+        printf("Failed to parse command\n");
+        return -1;
+    }
+    TRACE(TRACE_PARSE, TRACE_END);
+    startup_trace_mark("parse");
+    if (tokens->length == 0) {
+        return 0;
+    }
+    const char *first_token = strvec_get(tokens, 0);
+
+    // "timeout SECONDS COMMAND..." runs COMMAND in the foreground with a time limit
+    unsigned timeout_secs = 0;
+    if (strcmp(first_token, "timeout") == 0) {
+        const char *secs_token = strvec_get(tokens, 1);
+        int secs;
+        if (secs_token == NULL || (secs = atoi(secs_token)) <= 0 || tokens->length < 3) {
+            printf("Usage: timeout SECONDS COMMAND...\n");
+            *exit_status = 1;
+            return 0;
+        }
+        // The timer belongs to the foreground wait, so a background job would silently lose it
+        if (strcmp(strvec_get(tokens, tokens->length - 1), "&") == 0) {
+            printf("timeout: cannot limit a background job\n");
+            *exit_status = 1;
+            return 0;
+        }
+        timeout_secs = secs;
+        strvec_drop(tokens, 2);
+        first_token = strvec_get(tokens, 0);
+    }
+
+    // "run [OPTIONS] COMMAND..." launches COMMAND with resource limits applied
+    launch_opts_t opts;
+    launch_opts_init(&opts);
+    int has_run = 0;
+    if (strcmp(first_token, "run") == 0) {
+        if (launch_opts_parse(tokens, &opts) == -1) {
+            *exit_status = 1;
+            return 0;
+        }
+        first_token = strvec_get(tokens, 0);
+        has_run = 1;
+    }
+
+    // Builtins run inside the shell, where a time limit or launch options would be ignored
+    if ((timeout_secs > 0 || has_run) && is_builtin(first_token)) {
+        printf("%s: cannot be used with builtin %s\n", has_run ? "run" : "timeout", first_token);
+        *exit_status = 1;
+        return 0;
+    }
+    if (launch_opts_prepare(&opts) == -1) {
+        *exit_status = 1;
+        return 0;
+    }
+
+    if (strcmp(first_token, "pwd") == 0) {
+        char cwd[CMD_LEN];
+        if (getcwd(cwd, sizeof(cwd)) != NULL) {
+            printf("%s\n", cwd);
+        } else {
+            perror("getcwd");
+            *exit_status = 1;
+        }
+    }
+
+    else if (strcmp(first_token, "cd") == 0) {
+        const char *second_token;
+        // Check if there is a second token available
+        if ((second_token = strvec_get(tokens, 1)) != NULL) {
+            if (chdir(second_token) == -1) {
+                perror("chdir");
+                *exit_status = 1;
+            }
+        // If no token available, default to HOME
+        } else {
+            if (chdir(getenv("HOME")) == -1) {
+                perror("chdir");
+                *exit_status = 1;
+            }
+        }
+    }
+
+    else if (strcmp(first_token, "exit") == 0) {
         return 1;
     }
 
-    strvec_t tokens;
-    strvec_init(&tokens);
-    job_list_t jobs;
-    job_list_init(&jobs);
-    char cmd[CMD_LEN];
+    else if (strcmp(first_token, "ulimit") == 0) {
+        if (set_resource_limit(tokens) == -1) {
+            printf("Failed to set resource limit\n");
+            *exit_status = 1;
+        }
+    }
 
-    printf("%s", PROMPT);
-    while (fgets(cmd, CMD_LEN, stdin) != NULL) {
-        // Need to remove trailing '\n' from cmd. There are fancier ways.
-        int i = 0;
-        while (cmd[i] != '\n') {
-            i++;
+    else if (strcmp(first_token, "trace") == 0) {
+        if (trace_command(tokens) == -1) {
+            printf("Failed to run trace command\n");
+            *exit_status = 1;
         }
-        cmd[i] = '\0';
+    }
 
-        if (tokenize(cmd, &tokens) != 0) {
-            printf("Failed to parse command\n");
-            strvec_clear(&tokens);
-            job_list_free(&jobs);
-            return 1;
+    else if (strcmp(first_token, "coproc") == 0) {
+        if (start_coproc(tokens, jobs) == -1) {
+            printf("Failed to start coprocess\n");
+            *exit_status = 1;
         }
-        if (tokens.length == 0) {
-            printf("%s", PROMPT);
-            continue;
+    }
+
+    else if (strcmp(first_token, "coproc-write") == 0) {
+        if (write_coproc(tokens, jobs) == -1) {
+            printf("Failed to write to coprocess\n");
+            *exit_status = 1;
+        }
+    }
+
+    else if (strcmp(first_token, "coproc-read") == 0) {
+        if (ensure_event_loop(loop) == -1 || read_coproc(tokens, jobs, loop) == -1) {
+            printf("Failed to read from coprocess\n");
+            *exit_status = 1;
+        }
+    }
+
+    else if (strcmp(first_token, "coproc-close") == 0) {
+        if (close_coproc(tokens, jobs) == -1) {
+            printf("Failed to close coprocess\n");
+            *exit_status = 1;
         }
-        const char *first_token = strvec_get(&tokens, 0);
+    }
 
-        if (strcmp(first_token, "pwd") == 0) {
-            char cwd[CMD_LEN];
-            if (getcwd(cwd, sizeof(cwd)) != NULL) {
-                printf("%s\n", cwd);
+    else if (strcmp(first_token, "jobs") == 0) {
+        int i = 0;
+        job_t *current = jobs->head;
+        while (current != NULL) {
+            char *status_desc;
+            if (current->status == BACKGROUND) {
+                status_desc = "background";
+            } else if (current->status == COPROC) {
+                status_desc = "coproc";
             } else {
-                perror("getcwd");
+                status_desc = "stopped";
             }
+            printf("%d: %s (%s)\n", i, current->name, status_desc);
+            i++;
+            current = current->next;
         }
+    }
+
+    else if (strcmp(first_token, "fg") == 0) {
+        int status;
+        if (ensure_event_loop(loop) == -1 || resume_job(tokens, jobs, 1, loop, &status) == -1) {
+            printf("Failed to resume job in foreground\n");
+            *exit_status = 1;
+        } else {
+            *exit_status = job_exit_status(status);
+        }
+    }
 
-        else if (strcmp(first_token, "cd") == 0) {
-            const char *second_token;
-            // Check if there is a second token available
-            if ((second_token = strvec_get(&tokens, 1)) != NULL) {
-                if (chdir(second_token) == -1) {
-                    perror("chdir");
+    else if (strcmp(first_token, "bg") == 0) {
+        if (resume_job(tokens, jobs, 0, loop, NULL) == -1) {
+            printf("Failed to resume job in background\n");
+            *exit_status = 1;
+        }
+    }
+
+    else if (strcmp(first_token, "wait-for") == 0) {
+        int status;
+        if (ensure_event_loop(loop) == -1 ||
+            await_background_job(tokens, jobs, loop, &status) == -1) {
+            printf("Failed to wait for background job\n");
+            *exit_status = 1;
+        } else {
+            *exit_status = job_exit_status(status);
+        }
+    }
+
+    else if (strcmp(first_token, "wait-all") == 0) {
+        if (await_all_background_jobs(jobs) == -1) {
+            printf("Failed to wait for all background jobs\n");
+            *exit_status = 1;
+        }
+    }
+
+    // Nothing runs after a one-shot foreground command, so it can simply replace the shell,
+    // unless the shell has to stay around to remove the job's cgroup afterwards
+    else if (one_shot && timeout_secs == 0 && opts.cgroup[0] == '\0' &&
+             strcmp(strvec_get(tokens, tokens->length - 1), "&") != 0) {
+        opts.own_process_group = 0;
+        run_command(tokens, &opts);
+        return -1;
+    }
+
+    else {
+        // Call fork
+        pid_t pid;
+        fflush(stdout);
+        TRACE(TRACE_FORK, TRACE_BEGIN);
+        if ((pid = fork()) == -1) {
+            TRACE(TRACE_FORK, TRACE_END);
+            perror("fork");
+            return -1;
+        }
+        // Child process
+        if (pid == 0) {
+            startup_trace_mark("fork");
+            if (strcmp(strvec_get(tokens, tokens->length - 1), "&") == 0) {
+                strvec_take(tokens, tokens->length - 1);
+            }
+            run_command(tokens, &opts);
+            exit(1);
+
+        } else { // Parent process
+            TRACE(TRACE_FORK, TRACE_END);
+            launch_opts_place(&opts, pid);
+            // The child prints the startup report right before its exec
+            startup_trace_stop();
+
+            // Check if last token is "&"
+            if (strcmp(strvec_get(tokens, tokens->length - 1), "&") == 0) {
+                // Set job as background
+                job_status_t status = BACKGROUND;  // Set job as background
+                if (job_list_add(jobs, pid, first_token, status) == -1) {
+                    printf("Failed to add job to list\n");
                 }
-            // If no token available, default to HOME
+            // foreground case
             } else {
-                if (chdir(getenv("HOME")) == -1) {
-                    perror("chdir");
+                // Only hand over a terminal we are the foreground of, which rules out -c from
+                // a script or a server session whose stdin belongs to a client
+                int has_tty = tcgetpgrp(STDIN_FILENO) == getpgrp();
+                TRACE(TRACE_TCSETPGRP, TRACE_BEGIN);
+                if (has_tty && tcsetpgrp(STDIN_FILENO, pid) == -1) {
+                    TRACE(TRACE_TCSETPGRP, TRACE_END);
+                    perror("tcsetpgrp");
+                    return -1;
+                }
+                TRACE(TRACE_TCSETPGRP, TRACE_END);
+
+                if (ensure_event_loop(loop) == -1) {
+                    return -1;
+                }
+                int status;
+                int timed_out;
+                TRACE(TRACE_WAIT, TRACE_BEGIN);
+                if ((timed_out = await_foreground_job(loop, pid, timeout_secs, &status)) == -1) {
+                    TRACE(TRACE_WAIT, TRACE_END);
+                    return -1;
+                }
+                TRACE(TRACE_WAIT, TRACE_END);
+                pid_t ppid = getpid();
+                if (has_tty && tcsetpgrp(STDIN_FILENO, ppid) == -1) {
+                    perror("tcsetpgrp");
+                    return -1;
+                }
+                *exit_status = timed_out ? TIMEOUT_STATUS : job_exit_status(status);
+                if (WIFSTOPPED(status)) {
+                    // Set job as stopped
+                    job_status_t status = STOPPED;
+                    if (job_list_add(jobs, pid, first_token, status) == -1) {
+                        printf("Failed to add job to list");
+                    }
                 }
             }
-        }
 
-        else if (strcmp(first_token, "exit") == 0) {
-            strvec_clear(&tokens);
-            break;
         }
+    }
 
-        else if (strcmp(first_token, "jobs") == 0) {
-            int i = 0;
-            job_t *current = jobs.head;
-            while (current != NULL) {
-                char *status_desc;
-                if (current->status == BACKGROUND) {
-                    status_desc = "background";
-                } else {
-                    status_desc = "stopped";
-                }
-                printf("%d: %s (%s)\n", i, current->name, status_desc);
-                i++;
-                current = current->next;
+    return 0;
+}
+
+/*
+ * Run as a server: accept clients on a Unix socket and run their batches of commands
+ * Every client gets a session forked from this already warmed-up shell, with its own cwd
+ * and jobs list, and with the client's fds as its stdio
+ * socket_path: Where to listen for clients
+ * tokens: Empty string vector to tokenize commands into
+ * jobs: The shell's (empty) jobs list, which each session inherits
+ * loop: The shell's event loop, not yet initialized
+ * Returns the shell's exit status
+ */
+static int serve(const char *socket_path, strvec_t *tokens, job_list_t *jobs, event_loop_t *loop) {
+    int listen_fd;
+    if ((listen_fd = server_listen(socket_path)) == -1) {
+        return 1;
+    }
+    int cached;
+    if ((cached = command_cache_warm()) == -1) {
+        close(listen_fd);
+        return 1;
+    }
+    fprintf(stderr, "Listening on %s with %d commands cached\n", socket_path, cached);
+
+    // Everything below runs in a session process, one per client
+    int conn_fd;
+    if ((conn_fd = server_accept(listen_fd)) == -1) {
+        return 1;
+    }
+    if (ensure_event_loop(loop) == -1 || event_loop_detach_input(loop) == -1) {
+        return 1;
+    }
+
+    char batch[SERVER_BATCH_LEN];
+    char cmd[CMD_LEN];
+    unsigned batch_len;
+    int received = 0;
+    int result = 0;
+    while (result == 0 &&
+           (received = server_read_batch(conn_fd, batch, SERVER_BATCH_LEN, &batch_len)) == 1) {
+        // A failed refresh leaves commands to the usual PATH search, so the batch can still run
+        command_cache_refresh();
+
+        uint32_t index = 0;
+        int status = 0;
+        char *line = batch;
+        char *end = batch + batch_len;
+
+        while (result == 0 && line < end) {
+            char *newline = memchr(line, '\n', end - line);
+            size_t line_len = (newline != NULL ? newline : end) - line;
+            if (line_len >= CMD_LEN) {
+                fprintf(stderr, "Command longer than %d characters\n", CMD_LEN - 1);
+                status = 1;
+            } else {
+                memcpy(cmd, line, line_len);
+                cmd[line_len] = '\0';
+                result = eval_command(cmd, tokens, jobs, loop, 0, &status);
+                strvec_clear(tokens);
             }
-        }
 
-        else if (strcmp(first_token, "fg") == 0) {
-            if (resume_job(&tokens, &jobs, 1) == -1) {
-                printf("Failed to resume job in foreground\n");
+            // Builtin output has to reach the client before the status that follows it
+            fflush(stdout);
+            reap_background_jobs(jobs, 0);
+            launch_cgroups_cleanup();
+            trace_flush();
+            fflush(stdout);
+            if (server_send_status(conn_fd, index++, status) == -1) {
+                result = -1;
             }
+            line += line_len + 1;
         }
 
-        else if (strcmp(first_token, "bg") == 0) {
-            if (resume_job(&tokens, &jobs, 0) == -1) {
-                printf("Failed to resume job in background\n");
-            }
+        if (result != -1 && server_send_status(conn_fd, SERVER_BATCH_END, status) == -1) {
+            result = -1;
         }
+    }
 
-        else if (strcmp(first_token, "wait-for") == 0) {
-            if (await_background_job(&tokens, &jobs) == -1) {
-                printf("Failed to wait for background job\n");
-            }
+    trace_close();
+    close(conn_fd);
+    return result == -1 || received == -1;
+}
+
+int main(int argc, char **argv) {
+    const char *command = NULL;
+    const char *socket_path = NULL;
+    for (int i = 1; i < argc; i++) {
+        if (strcmp(argv[i], "--startup-trace") == 0) {
+            startup_trace_start();
+        } else if (strcmp(argv[i], "-c") == 0 && i + 1 < argc && socket_path == NULL) {
+            command = argv[++i];
+        } else if (strcmp(argv[i], "--server") == 0 && i + 1 < argc && command == NULL) {
+            socket_path = argv[++i];
+        } else {
+            fprintf(stderr, USAGE, argv[0]);
+            return 1;
         }
+    }
 
-        else if (strcmp(first_token, "wait-all") == 0) {
-            if (await_all_background_jobs(&jobs) == -1) {
-                printf("Failed to wait for all background jobs\n");
-            }
+    struct sigaction sac;
+    sac.sa_handler = SIG_IGN;
+    if (sigfillset(&sac.sa_mask) == -1) {
+        perror("sigfillset");
+        return 1;
+    }
+    sac.sa_flags = 0;
+    if (sigaction(SIGTTIN, &sac, NULL) == -1 || sigaction(SIGTTOU, &sac, NULL) == -1) {
+        perror("sigaction");
+        return 1;
+    }
+    startup_trace_mark("signals");
+
+    // Nothing here allocates: vectors grow on first add and the event loop is only
+    // created once something has to wait on it
+    strvec_t tokens;
+    strvec_init(&tokens);
+    job_list_t jobs;
+    job_list_init(&jobs);
+    event_loop_t loop;
+    loop.epoll_fd = -1;
+
+    if (command != NULL) {
+        // Running a truncated command would run something other than what was asked for
+        if (strlen(command) >= CMD_LEN) {
+            fprintf(stderr, "Command longer than %d characters\n", CMD_LEN - 1);
+            return 1;
+        }
+        char cmd[CMD_LEN];
+        strcpy(cmd, command);
+        int status;
+        int result = eval_command(cmd, &tokens, &jobs, &loop, 1, &status);
+        startup_trace_report();
+        launch_cgroups_cleanup();
+        strvec_clear(&tokens);
+        job_list_free(&jobs);
+        if (loop.epoll_fd != -1) {
+            event_loop_free(&loop);
+        }
+        return result == -1 ? 1 : status;
+    }
+
+    if (socket_path != NULL) {
+        int ret = serve(socket_path, &tokens, &jobs, &loop);
+        strvec_clear(&tokens);
+        job_list_free(&jobs);
+        if (loop.epoll_fd != -1) {
+            event_loop_free(&loop);
         }
+        command_cache_clear();
+        return ret;
+    }
 
-        else {
-            // Call fork
-            pid_t pid;
-            if ((pid = fork()) == -1) {
-                perror("fork");
-                return -1;
+    if (event_loop_init(&loop) == -1) {
+        return 1;
+    }
+    startup_trace_mark("init");
+    char cmd[CMD_LEN];
+    int ret = 0;
+
+    show_prompt(&jobs);
+    while (1) {
+        int got_line = event_loop_next_line(&loop, cmd, CMD_LEN);
+        if (got_line == -1) {
+            fprintf(stderr, "Command longer than %d characters\n", CMD_LEN - 1);
+            show_prompt(&jobs);
+            continue;
+        } else if (got_line == 0) {
+            if (loop.input_eof) {
+                break;
             }
-            // Child process
-            if (pid == 0) {
-                if (strcmp(strvec_get(&tokens, tokens.length - 1), "&") == 0) {
-                    strvec_take(&tokens, tokens.length - 1);
-                }
-                run_command(&tokens);
-                return 1;
-
-            } else { // Parent process
-                // Check if last token is "&"
-                if (strcmp(strvec_get(&tokens, tokens.length - 1), "&") == 0) {
-                    // Set job as background
-                    job_status_t status = BACKGROUND;  // Set job as background
-                    if (job_list_add(&jobs, pid, first_token, status) == -1) {
-                        printf("Failed to add job to list\n");
-                    }
-                // foreground case
-                } else {
-                    if (tcsetpgrp(STDIN_FILENO, pid) == -1) {
-                        perror("tcsetpgrp");
-                        return -1;
-                    }
 
-                    int status;
-                    waitpid(pid, &status, WUNTRACED);
-                    pid_t ppid = getpid();
-                    if (tcsetpgrp(STDIN_FILENO, ppid) == -1) {
-                        perror("tcsetpgrp");
-                        return -1;
-                    }
-                    if (WIFSTOPPED(status)) {
-                        // Set job as stopped
-                        job_status_t status = STOPPED;
-                        if (job_list_add(&jobs, pid, first_token, status) == -1) {
-                            printf("Failed to add job to list");
-                        }
-                    }
+            // Nothing to run yet, so wait for more input or for a job to change state
+            int event = event_loop_next(&loop, 1);
+            if (event == -1) {
+                ret = 1;
+                break;
+            } else if (event == EVENT_INPUT) {
+                if (event_loop_read_input(&loop) == -1) {
+                    ret = 1;
+                    break;
                 }
-
+            } else if (event == EVENT_SIGCHLD) {
+                if (reap_background_jobs(&jobs, 1) > 0) {
+                    show_prompt(&jobs);
+                }
+            } else if (event == EVENT_SIGINT) {
+                event_loop_discard_input(&loop);
+                printf("\n");
+                show_prompt(&jobs);
             }
+            continue;
         }
 
+        int status;
+        int result = eval_command(cmd, &tokens, &jobs, &loop, 0, &status);
+        startup_trace_report();
         strvec_clear(&tokens);
-        printf("%s", PROMPT);
+        if (result == -1) {
+            ret = 1;
+            break;
+        } else if (result == 1) {
+            break;
+        }
+        show_prompt(&jobs);
     }
 
+    trace_close();
     job_list_free(&jobs);
-    return 0;
+    launch_cgroups_cleanup();
+    event_loop_free(&loop);
+    return ret;
 }
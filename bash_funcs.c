@@ -3,20 +3,29 @@
 #include "bash_funcs.h"
 
 #include <assert.h>
+#include <errno.h>
 #include <fcntl.h>
 #include <signal.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <sys/ioctl.h>
+#include <sys/socket.h>
 #include <sys/stat.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 #include <unistd.h>
 
+#include "command_cache.h"
+#include "event_loop.h"
 #include "job_list.h"
+#include "launch.h"
+#include "startup_trace.h"
 #include "string_vector.h"
+#include "trace.h"
 
 #define MAX_ARGS 10
+#define TIMEOUT_GRACE_SECS 5    // How long a timed out job has to exit after SIGTERM
 
 int tokenize(char *s, strvec_t *tokens) {
 
@@ -38,8 +47,13 @@ int tokenize(char *s, strvec_t *tokens) {
     return 0;
 }
 
-int run_command(strvec_t *tokens) {
-
+/*
+ * Prepare a freshly forked child to exec a command: signals, process group, launch options
+ * and redirections
+ * args: Array of tokens->length + 1 entries, filled with the NULL-terminated exec arguments
+ * Returns 0 on success or -1 on error
+ */
+static int setup_child(strvec_t *tokens, const launch_opts_t *opts, char **args) {
     // Init sig
     struct sigaction sac;
     sac.sa_handler = SIG_DFL;
@@ -53,13 +67,25 @@ int run_command(strvec_t *tokens) {
         return -1;
     }
 
+    // The shell's event loop blocks SIGCHLD, SIGINT and SIGTSTP and the mask survives exec
+    sigset_t mask;
+    sigemptyset(&mask);
+    if (sigprocmask(SIG_SETMASK, &mask, NULL) == -1) {
+        perror("sigprocmask");
+        return -1;
+    }
+
     pid_t pid = getpid();
-    if (setpgid(pid, pid) == -1) {
+    if ((opts == NULL || opts->own_process_group) && setpgid(pid, pid) == -1) {
         perror("setpgid");
         return -1;
     }
 
-    char *args[tokens->length + 1];
+    // Limits, affinity and cgroup placement requested with the "run" prefix
+    if (opts != NULL && launch_opts_apply(opts) == -1) {
+        return -1;
+    }
+
     int arg_count = 0;
 
     // Process tokens and prepare args for exec
@@ -149,8 +175,27 @@ int run_command(strvec_t *tokens) {
         }
     }
 
-    // Exec
     args[arg_count] = NULL;
+    return 0;
+}
+
+int run_command(strvec_t *tokens, const launch_opts_t *opts) {
+    char *args[tokens->length + 1];
+    TRACE(TRACE_SETUP, TRACE_BEGIN);
+    if (setup_child(tokens, opts, args) == -1) {
+        TRACE(TRACE_SETUP, TRACE_END);
+        return -1;
+    }
+
+    // Exec
+    startup_trace_report();
+    TRACE(TRACE_SETUP, TRACE_END);
+    TRACE(TRACE_EXEC, TRACE_INSTANT);
+    const char *path;
+    if (strchr(args[0], '/') == NULL && (path = command_cache_lookup(args[0])) != NULL) {
+        // Only returns if the cached file went away, in which case PATH is searched as usual
+        execv(path, args);
+    }
     if (execvp(args[0], args) == -1) {
         perror("exec");
         return -1;
@@ -159,7 +204,8 @@ int run_command(strvec_t *tokens) {
     return 0;
 }
 
-int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground) {
+int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground, event_loop_t *loop,
+               int *status) {
     // Parse the job index from tokens[1]
     // Get the job token from the index
     char *job_token_char = strvec_get(tokens, 1);
@@ -182,9 +228,17 @@ int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground) {
         return -1;
     }
 
+    // Coprocesses are looked up by their COPROC status, so they must never change it
+    if (job->coproc != NULL) {
+        fprintf(stderr, "Job %d is coprocess %s, use coproc-close instead\n", job_token, job->name);
+        return -1;
+    }
+
     // Move the job's process group to the foreground
     if (is_foreground) {
-        if (tcsetpgrp(STDIN_FILENO, job->pid) == -1) {
+        // Only hand over a terminal we are the foreground of, as for new foreground jobs
+        int has_tty = tcgetpgrp(STDIN_FILENO) == getpgrp();
+        if (has_tty && tcsetpgrp(STDIN_FILENO, job->pid) == -1) {
             perror("tcsetpgrp");
             return -1;
         }
@@ -195,23 +249,25 @@ int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground) {
             return -1;
         }
 
-        // Wait for the process to continue (or terminate)
-        int status;
-        waitpid(job->pid, &status, WUNTRACED);
-
-        // Check if the job terminated (either normally or via a signal)
-        if (WIFEXITED(status) || WIFSIGNALED(status)) {
+        // Wait for the process to stop again (or terminate) through the event loop
+        int ret = 0;
+        if (await_foreground_job(loop, job->pid, 0, status) == -1) {
+            ret = -1;
+        } else if (WIFEXITED(*status) || WIFSIGNALED(*status)) {
             if (job_list_remove(jobs, job_token) == -1) {
                 fprintf(stderr, "Failed to remove job from list\n");
             }
+        } else {
+            job->status = STOPPED;
         }
 
         // Restore the shell to the foreground
         pid_t shell_pid = getpid();
-        if (tcsetpgrp(STDIN_FILENO, shell_pid) == -1) {
+        if (has_tty && tcsetpgrp(STDIN_FILENO, shell_pid) == -1) {
             perror("tcsetpgrp");
             return -1;
         }
+        return ret;
     } else { // background move
         job->status = BACKGROUND;
         // Send the SIGCONT signal to the process
@@ -224,7 +280,7 @@ int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground) {
     return 0;
 }
 
-int await_background_job(strvec_t *tokens, job_list_t *jobs) {
+int await_background_job(strvec_t *tokens, job_list_t *jobs, event_loop_t *loop, int *status) {
     // Get the job token from the index
     char *job_token_char = strvec_get(tokens, 1);
     if (job_token_char == NULL) {
@@ -246,20 +302,29 @@ int await_background_job(strvec_t *tokens, job_list_t *jobs) {
         return -1;
     }
 
+    // Coprocesses are looked up by their COPROC status, so they must never change it
+    if (job->coproc != NULL) {
+        fprintf(stderr, "Job %d is coprocess %s, use coproc-close instead\n", job_token, job->name);
+        return -1;
+    }
+
     if (job->status != BACKGROUND) {
         fprintf(stderr, "Job index is for stopped process not background process\n");
         return -1;
     }
 
-    // Wait for the job to terminate
-    int status;
-    waitpid(job->pid, &status, WUNTRACED);
+    // Wait for the job to terminate (or stop) through the event loop
+    if (await_foreground_job(loop, job->pid, 0, status) == -1) {
+        return -1;
+    }
 
     // Remove job from the list of jobs
-    if (WIFEXITED(status)) {
+    if (WIFEXITED(*status) || WIFSIGNALED(*status)) {
         if (job_list_remove(jobs, job_token) == -1) {
             fprintf(stderr, "Failed to remove job from list\n");
         }
+    } else if (WIFSTOPPED(*status)) {
+        job->status = STOPPED;
     }
 
     return 0;
@@ -287,3 +352,306 @@ int await_all_background_jobs(job_list_t *jobs) {
 
     return 0;
 }
+
+int await_foreground_job(event_loop_t *loop, pid_t pid, unsigned timeout_secs, int *status) {
+    if (timeout_secs > 0 && event_loop_set_timer(loop, timeout_secs) == -1) {
+        return -1;
+    }
+
+    int ret = 0;
+    int timed_out = 0;
+    while (1) {
+        // The child may already have changed state before we got here
+        pid_t waited = waitpid(pid, status, WNOHANG | WUNTRACED);
+        if (waited == -1) {
+            perror("waitpid");
+            ret = -1;
+            break;
+        }
+        if (waited == pid) {
+            TRACE_CHILD(TRACE_REAP, TRACE_INSTANT, pid);
+            if (timed_out && !WIFSTOPPED(*status)) {
+                ret = 1;
+            }
+            break;
+        }
+
+        int event = event_loop_next(loop, 0);
+        if (event == -1) {
+            ret = -1;
+            break;
+        }
+        if (event == EVENT_TIMER && !timed_out) {
+            // Ask nicely first, then give the job a grace period before killing it outright
+            fprintf(stderr, "Job timed out after %u seconds\n", timeout_secs);
+            if (kill(-pid, SIGTERM) == -1 && errno != ESRCH) {
+                perror("Failed to send SIGTERM");
+            }
+            if (event_loop_set_timer(loop, TIMEOUT_GRACE_SECS) == -1) {
+                ret = -1;
+                break;
+            }
+            timed_out = 1;
+        } else if (event == EVENT_TIMER) {
+            fprintf(stderr, "Job ignored SIGTERM, killing it\n");
+            if (kill(-pid, SIGKILL) == -1 && errno != ESRCH) {
+                perror("Failed to send SIGKILL");
+            }
+        }
+    }
+
+    if (timeout_secs > 0 && event_loop_set_timer(loop, 0) == -1) {
+        return -1;
+    }
+    return ret;
+}
+
+int reap_background_jobs(job_list_t *jobs, int at_prompt) {
+    int reaped = 0;
+    unsigned i = 0;
+    job_t *job = jobs->head;
+
+    while (job != NULL) {
+        job_t *next = job->next;
+
+        // Already reaped, and only kept around until its output has been read
+        if (job->coproc != NULL && job->coproc->exited) {
+            i++;
+            job = next;
+            continue;
+        }
+
+        int status;
+        pid_t waited = waitpid(job->pid, &status, WNOHANG | WUNTRACED);
+
+        if (waited == job->pid && (WIFEXITED(status) || WIFSIGNALED(status))) {
+            TRACE_CHILD(TRACE_REAP, TRACE_INSTANT, job->pid);
+            // Move off the prompt the user may be typing at
+            if (at_prompt && reaped == 0) {
+                printf("\n");
+            }
+            printf("%u: %s (done)\n", i, job->name);
+            reaped++;
+
+            int unread = 0;
+            if (job->coproc != NULL && (job->coproc->buf_len > 0 ||
+                                        (ioctl(job->coproc->fd, FIONREAD, &unread) == 0 &&
+                                         unread > 0))) {
+                job->coproc->exited = 1;
+                i++;
+            } else if (job_list_remove(jobs, i) == -1) {
+                fprintf(stderr, "Failed to remove job from list\n");
+                return -1;
+            }
+        } else {
+            // A stopped coprocess is still addressed by name, so it keeps its status
+            if (waited == job->pid && WIFSTOPPED(status) && job->coproc == NULL) {
+                job->status = STOPPED;
+            }
+            i++;
+        }
+        job = next;
+    }
+
+    return reaped;
+}
+
+/*
+ * Remove a coprocess that has exited and whose output has all been read
+ * Returns 0 on success or -1 on error
+ */
+static int remove_coproc(job_list_t *jobs, job_t *job) {
+    unsigned i = 0;
+    for (job_t *current = jobs->head; current != job; current = current->next) {
+        i++;
+    }
+    if (job_list_remove(jobs, i) == -1) {
+        fprintf(stderr, "Failed to remove job from list\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Look up the coprocess named by tokens[1]
+ * Returns the coprocess's job, or NULL (after printing why) if there is none
+ */
+static job_t *find_coproc(strvec_t *tokens, job_list_t *jobs) {
+    const char *name = strvec_get(tokens, 1);
+    if (name == NULL) {
+        fprintf(stderr, "Missing coprocess name\n");
+        return NULL;
+    }
+
+    job_t *job = job_list_find(jobs, name, COPROC);
+    if (job == NULL) {
+        fprintf(stderr, "No coprocess named %s\n", name);
+    }
+    return job;
+}
+
+int start_coproc(strvec_t *tokens, job_list_t *jobs) {
+    const char *name = strvec_get(tokens, 1);
+    if (name == NULL || tokens->length < 3) {
+        fprintf(stderr, "Usage: coproc NAME COMMAND...\n");
+        return -1;
+    }
+    if (job_list_find(jobs, name, COPROC) != NULL) {
+        fprintf(stderr, "Coprocess %s is already running\n", name);
+        return -1;
+    }
+
+    // A socket rather than a pair of pipes: one fd in each direction, and writes to a
+    // coprocess that already exited can use MSG_NOSIGNAL instead of killing the shell
+    int fds[2];
+    if (socketpair(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0, fds) == -1) {
+        perror("socketpair");
+        return -1;
+    }
+
+    fflush(stdout);
+    pid_t pid;
+    if ((pid = fork()) == -1) {
+        perror("fork");
+        close(fds[0]);
+        close(fds[1]);
+        return -1;
+    }
+
+    // Child process
+    if (pid == 0) {
+        if (dup2(fds[1], STDIN_FILENO) == -1 || dup2(fds[1], STDOUT_FILENO) == -1) {
+            perror("dup2");
+            exit(1);
+        }
+        strvec_drop(tokens, 2);
+        run_command(tokens, NULL);
+        exit(1);
+    }
+
+    close(fds[1]);
+    if (job_list_add_coproc(jobs, pid, name, fds[0]) == -1) {
+        fprintf(stderr, "Failed to add job to list\n");
+        close(fds[0]);
+        return -1;
+    }
+    return 0;
+}
+
+int write_coproc(strvec_t *tokens, job_list_t *jobs) {
+    job_t *job = find_coproc(tokens, jobs);
+    if (job == NULL) {
+        return -1;
+    }
+
+    // Join the remaining tokens back into a single line
+    size_t len = 0;
+    for (unsigned i = 2; i < tokens->length; i++) {
+        len += strlen(strvec_get(tokens, i)) + 1;
+    }
+    char line[len + 1];
+    len = 0;
+    for (unsigned i = 2; i < tokens->length; i++) {
+        const char *token = strvec_get(tokens, i);
+        if (i > 2) {
+            line[len++] = ' ';
+        }
+        memcpy(line + len, token, strlen(token));
+        len += strlen(token);
+    }
+    line[len++] = '\n';
+
+    size_t written = 0;
+    while (written < len) {
+        ssize_t n = send(job->coproc->fd, line + written, len - written, MSG_NOSIGNAL);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("send");
+            return -1;
+        }
+        written += n;
+    }
+    return 0;
+}
+
+int read_coproc(strvec_t *tokens, job_list_t *jobs, event_loop_t *loop) {
+    job_t *job = find_coproc(tokens, jobs);
+    if (job == NULL) {
+        return -1;
+    }
+    coproc_t *coproc = job->coproc;
+
+    while (1) {
+        char *newline = memchr(coproc->buf, '\n', coproc->buf_len);
+        unsigned line_len = 0;
+        if (newline != NULL) {
+            line_len = newline - coproc->buf + 1;
+        } else if (coproc->buf_len == COPROC_BUF_LEN) {
+            line_len = COPROC_BUF_LEN;    // Overlong lines are handed out in pieces
+        }
+
+        if (line_len > 0) {
+            fwrite(coproc->buf, 1, line_len, stdout);
+            if (newline == NULL) {
+                printf("\n");
+            }
+            coproc->buf_len -= line_len;
+            memmove(coproc->buf, coproc->buf + line_len, coproc->buf_len);
+            return 0;
+        }
+
+        // Wait through the event loop so Ctrl-C can still get us out of a silent coprocess
+        int event = event_loop_wait_fd(loop, coproc->fd);
+        if (event == -1) {
+            return -1;
+        } else if (event == EVENT_SIGINT) {
+            printf("\n");
+            return -1;
+        }
+
+        ssize_t n = read(coproc->fd, coproc->buf + coproc->buf_len,
+                         COPROC_BUF_LEN - coproc->buf_len);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("read");
+            return -1;
+        }
+        if (n == 0) {
+            // Hand out a final line that had no trailing newline
+            if (coproc->buf_len > 0) {
+                fwrite(coproc->buf, 1, coproc->buf_len, stdout);
+                printf("\n");
+                coproc->buf_len = 0;
+                return 0;
+            }
+            fprintf(stderr, "Coprocess %s closed its output\n", job->name);
+            if (coproc->exited) {
+                remove_coproc(jobs, job);
+            }
+            return -1;
+        }
+        coproc->buf_len += n;
+    }
+}
+
+int close_coproc(strvec_t *tokens, job_list_t *jobs) {
+    job_t *job = find_coproc(tokens, jobs);
+    if (job == NULL) {
+        return -1;
+    }
+
+    if (job->coproc->exited) {
+        return remove_coproc(jobs, job);
+    }
+
+    // The coprocess sees end of input and is reaped like any other job once it exits
+    if (shutdown(job->coproc->fd, SHUT_WR) == -1) {
+        perror("shutdown");
+        return -1;
+    }
+    return 0;
+}
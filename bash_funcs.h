@@ -1,17 +1,34 @@
 #ifndef BASH_FUNCS_H
 #define BASH_FUNCS_H
 
+#include "event_loop.h"
 #include "job_list.h"
+#include "launch.h"
 #include "string_vector.h"
 
+#define TIMEOUT_STATUS 124    // Exit status of a job killed by the timeout builtin, as in coreutils
+
 int tokenize(char *s, strvec_t *tokens);
 
-int run_command(strvec_t *tokens);
+int run_command(strvec_t *tokens, const launch_opts_t *opts);
 
-int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground);
+int resume_job(strvec_t *tokens, job_list_t *jobs, int is_foreground, event_loop_t *loop,
+               int *status);
 
-int await_background_job(strvec_t *tokens, job_list_t *jobs);
+int await_background_job(strvec_t *tokens, job_list_t *jobs, event_loop_t *loop, int *status);
 
 int await_all_background_jobs(job_list_t *jobs);
 
+int await_foreground_job(event_loop_t *loop, pid_t pid, unsigned timeout_secs, int *status);
+
+int reap_background_jobs(job_list_t *jobs, int at_prompt);
+
+int start_coproc(strvec_t *tokens, job_list_t *jobs);
+
+int write_coproc(strvec_t *tokens, job_list_t *jobs);
+
+int read_coproc(strvec_t *tokens, job_list_t *jobs, event_loop_t *loop);
+
+int close_coproc(strvec_t *tokens, job_list_t *jobs);
+
 #endif    // BASH_FUNCS_H
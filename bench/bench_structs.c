@@ -0,0 +1,192 @@
+/*
+ * Microbenchmarks for string_vector and job_list at sizes from 10 to 100k elements
+ * Output follows Google Benchmark's console format: name/size, time per operation, iterations
+ */
+
+#define _GNU_SOURCE
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "job_list.h"
+#include "string_vector.h"
+
+#define MIN_BENCH_NS 100000000ULL    // Keep repeating a benchmark for at least 0.1s
+#define MAX_LOOKUPS 1000
+
+/*
+ * A benchmark builds whatever it needs for size n, then times only the operations under test
+ * Returns the nanoseconds spent in the timed section and sets ops to how many operations it ran
+ */
+typedef uint64_t (*bench_fn_t)(unsigned n, unsigned *ops);
+
+static char names[16];
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static const char *name_for(unsigned i) {
+    snprintf(names, sizeof(names), "token%u", i);
+    return names;
+}
+
+static void fill_strvec(strvec_t *vec, unsigned n) {
+    strvec_init(vec);
+    for (unsigned i = 0; i < n; i++) {
+        strvec_add(vec, name_for(i));
+    }
+}
+
+static void fill_job_list(job_list_t *list, unsigned n) {
+    job_list_init(list);
+    for (unsigned i = 0; i < n; i++) {
+        job_list_add(list, i + 1, "job", i % 2 ? BACKGROUND : STOPPED);
+    }
+}
+
+static uint64_t bench_strvec_add(unsigned n, unsigned *ops) {
+    strvec_t vec;
+    strvec_init(&vec);
+    uint64_t start = now_ns();
+    for (unsigned i = 0; i < n; i++) {
+        strvec_add(&vec, "token");
+    }
+    uint64_t elapsed = now_ns() - start;
+    strvec_clear(&vec);
+    *ops = n;
+    return elapsed;
+}
+
+static uint64_t bench_strvec_find(unsigned n, unsigned *ops) {
+    strvec_t vec;
+    fill_strvec(&vec, n);
+    unsigned lookups = n < MAX_LOOKUPS ? n : MAX_LOOKUPS;
+    volatile int sink = 0;
+
+    uint64_t start = now_ns();
+    for (unsigned i = 0; i < lookups; i++) {
+        sink += strvec_find(&vec, name_for((unsigned) ((uint64_t) i * n / lookups)));
+    }
+    uint64_t elapsed = now_ns() - start;
+    (void) sink;
+
+    strvec_clear(&vec);
+    *ops = lookups;
+    return elapsed;
+}
+
+static uint64_t bench_strvec_take(unsigned n, unsigned *ops) {
+    strvec_t vec;
+    fill_strvec(&vec, n);
+    uint64_t start = now_ns();
+    strvec_take(&vec, 0);
+    uint64_t elapsed = now_ns() - start;
+    strvec_clear(&vec);
+    *ops = 1;
+    return elapsed;
+}
+
+static uint64_t bench_job_list_add(unsigned n, unsigned *ops) {
+    job_list_t list;
+    job_list_init(&list);
+    uint64_t start = now_ns();
+    for (unsigned i = 0; i < n; i++) {
+        job_list_add(&list, i + 1, "job", BACKGROUND);
+    }
+    uint64_t elapsed = now_ns() - start;
+    job_list_free(&list);
+    *ops = n;
+    return elapsed;
+}
+
+static uint64_t bench_job_list_get(unsigned n, unsigned *ops) {
+    job_list_t list;
+    fill_job_list(&list, n);
+    unsigned lookups = n < MAX_LOOKUPS ? n : MAX_LOOKUPS;
+    volatile pid_t sink = 0;
+
+    uint64_t start = now_ns();
+    for (unsigned i = 0; i < lookups; i++) {
+        sink += job_list_get(&list, (unsigned) ((uint64_t) i * n / lookups))->pid;
+    }
+    uint64_t elapsed = now_ns() - start;
+    (void) sink;
+
+    job_list_free(&list);
+    *ops = lookups;
+    return elapsed;
+}
+
+static uint64_t bench_job_list_remove(unsigned n, unsigned *ops) {
+    job_list_t list;
+    fill_job_list(&list, n);
+    uint64_t start = now_ns();
+    while (list.length > 0) {
+        job_list_remove(&list, 0);
+    }
+    uint64_t elapsed = now_ns() - start;
+    *ops = n;
+    return elapsed;
+}
+
+static uint64_t bench_job_list_remove_by_status(unsigned n, unsigned *ops) {
+    job_list_t list;
+    fill_job_list(&list, n);
+    uint64_t start = now_ns();
+    job_list_remove_by_status(&list, BACKGROUND);
+    uint64_t elapsed = now_ns() - start;
+    job_list_free(&list);
+    *ops = 1;
+    return elapsed;
+}
+
+static void run_benchmark(const char *name, bench_fn_t fn, unsigned n) {
+    uint64_t total_ns = 0;
+    uint64_t total_ops = 0;
+    unsigned iterations = 0;
+    while (total_ns < MIN_BENCH_NS) {
+        unsigned ops;
+        total_ns += fn(n, &ops);
+        total_ops += ops;
+        iterations++;
+    }
+
+    char label[64];
+    snprintf(label, sizeof(label), "%s/%u", name, n);
+    printf("%-40s %12.1f ns %12u\n", label, (double) total_ns / total_ops, iterations);
+}
+
+int main(int argc, char **argv) {
+    static const struct {
+        const char *name;
+        bench_fn_t fn;
+    } benchmarks[] = {
+        {"BM_strvec_add", bench_strvec_add},
+        {"BM_strvec_find", bench_strvec_find},
+        {"BM_strvec_take", bench_strvec_take},
+        {"BM_job_list_add", bench_job_list_add},
+        {"BM_job_list_get", bench_job_list_get},
+        {"BM_job_list_remove", bench_job_list_remove},
+        {"BM_job_list_remove_by_status", bench_job_list_remove_by_status},
+    };
+    static const unsigned sizes[] = {10, 100, 1000, 10000, 100000};
+
+    // An optional argument restricts the run to benchmarks whose name contains it
+    const char *filter = argc > 1 ? argv[1] : "";
+
+    printf("%-40s %15s %12s\n", "Benchmark", "Time/op", "Iterations");
+    for (unsigned b = 0; b < sizeof(benchmarks) / sizeof(benchmarks[0]); b++) {
+        if (strstr(benchmarks[b].name, filter) == NULL) {
+            continue;
+        }
+        for (unsigned s = 0; s < sizeof(sizes) / sizeof(sizes[0]); s++) {
+            run_benchmark(benchmarks[b].name, benchmarks[b].fn, sizes[s]);
+        }
+    }
+    return 0;
+}
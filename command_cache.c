@@ -0,0 +1,244 @@
+#define _GNU_SOURCE
+
+#include "command_cache.h"
+
+#include <dirent.h>
+#include <fcntl.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#define INITIAL_SIZE 1024    // Must be a power of two
+
+typedef struct {
+    char *name;
+    char *path;
+    unsigned dir;    // Index into dirs of the PATH directory the command was found in
+} cache_entry_t;
+
+// Every PATH directory as it was when the cache was warmed, to notice when one changes
+typedef struct {
+    char *path;
+    int exists;
+    struct timespec mtime;
+} path_dir_t;
+
+static cache_entry_t *entries = NULL;
+static unsigned capacity = 0;
+static unsigned length = 0;
+
+static path_dir_t *dirs = NULL;
+static unsigned num_dirs = 0;
+
+// FNV-1a, which is plenty for short command names
+static uint32_t hash_name(const char *name) {
+    uint32_t hash = 2166136261u;
+    for (; *name != '\0'; name++) {
+        hash = (hash ^ (unsigned char) *name) * 16777619u;
+    }
+    return hash;
+}
+
+/*
+ * Find the slot holding name, or the empty slot where it would go
+ */
+static cache_entry_t *find_slot(cache_entry_t *table, unsigned size, const char *name) {
+    unsigned i = hash_name(name) & (size - 1);
+    while (table[i].name != NULL && strcmp(table[i].name, name) != 0) {
+        i = (i + 1) & (size - 1);
+    }
+    return &table[i];
+}
+
+/*
+ * Double the table once it is half full, to keep probe sequences short
+ * Returns 0 on success or -1 on error
+ */
+static int grow(void) {
+    unsigned new_capacity = capacity == 0 ? INITIAL_SIZE : capacity * 2;
+    cache_entry_t *new_entries = calloc(new_capacity, sizeof(cache_entry_t));
+    if (new_entries == NULL) {
+        return -1;
+    }
+    for (unsigned i = 0; i < capacity; i++) {
+        if (entries[i].name != NULL) {
+            *find_slot(new_entries, new_capacity, entries[i].name) = entries[i];
+        }
+    }
+    free(entries);
+    entries = new_entries;
+    capacity = new_capacity;
+    return 0;
+}
+
+/*
+ * Check whether a PATH directory gained or lost entries since the cache was warmed
+ * Adding, removing or renaming a file updates its directory's mtime
+ * Returns 1 if it changed, 0 otherwise
+ */
+static int dir_changed(const path_dir_t *dir) {
+    struct stat st;
+    if (stat(dir->path, &st) == -1) {
+        return dir->exists;
+    }
+    return !dir->exists || st.st_mtim.tv_sec != dir->mtime.tv_sec ||
+           st.st_mtim.tv_nsec != dir->mtime.tv_nsec;
+}
+
+/*
+ * Record a PATH directory and its current mtime
+ * Returns 0 on success or -1 on error
+ */
+static int add_dir(const char *path) {
+    path_dir_t *new_dirs = realloc(dirs, (num_dirs + 1) * sizeof(path_dir_t));
+    if (new_dirs == NULL) {
+        return -1;
+    }
+    dirs = new_dirs;
+
+    path_dir_t *dir = &dirs[num_dirs];
+    if ((dir->path = strdup(path)) == NULL) {
+        return -1;
+    }
+    struct stat st;
+    dir->exists = stat(path, &st) == 0;
+    if (dir->exists) {
+        dir->mtime = st.st_mtim;
+    }
+    num_dirs++;
+    return 0;
+}
+
+/*
+ * Add a command unless an earlier PATH directory already provided it
+ * Returns 0 on success or -1 on error
+ */
+static int add_command(const char *dir, const char *name) {
+    if (2 * (length + 1) > capacity && grow() == -1) {
+        return -1;
+    }
+
+    cache_entry_t *slot = find_slot(entries, capacity, name);
+    if (slot->name != NULL) {
+        return 0;
+    }
+    if ((slot->name = strdup(name)) == NULL) {
+        return -1;
+    }
+    if (asprintf(&slot->path, "%s/%s", dir, name) == -1) {
+        free(slot->name);
+        slot->name = NULL;
+        return -1;
+    }
+    slot->dir = num_dirs - 1;
+    length++;
+    return 0;
+}
+
+int command_cache_warm(void) {
+    const char *path_env = getenv("PATH");
+    if (path_env == NULL) {
+        return 0;
+    }
+    char *path = strdup(path_env);
+    if (path == NULL) {
+        perror("strdup");
+        return -1;
+    }
+
+    // strsep() keeps empty entries, which execvp() treats as the current directory
+    char *rest = path;
+    char *dir;
+    while ((dir = strsep(&rest, ":")) != NULL) {
+        // What a relative entry holds depends on the cwd at exec time, and any command in it
+        // would shadow those in later directories, so those are left to the PATH search too
+        if (dir[0] != '/') {
+            break;
+        }
+
+        // The mtime is taken before reading, so a change made while we read still counts
+        if (add_dir(dir) == -1) {
+            perror("Failed to cache PATH directory");
+            free(path);
+            return -1;
+        }
+
+        DIR *d;
+        if ((d = opendir(dir)) == NULL) {
+            continue;    // Missing PATH entries are common and harmless
+        }
+
+        struct dirent *entry;
+        while ((entry = readdir(d)) != NULL) {
+            if (entry->d_name[0] == '.' ||
+                (entry->d_type != DT_REG && entry->d_type != DT_LNK && entry->d_type != DT_UNKNOWN)) {
+                continue;
+            }
+            if (faccessat(dirfd(d), entry->d_name, X_OK, AT_EACCESS) == -1) {
+                continue;
+            }
+            if (add_command(dir, entry->d_name) == -1) {
+                perror("Failed to cache command");
+                closedir(d);
+                free(path);
+                return -1;
+            }
+        }
+        closedir(d);
+    }
+
+    free(path);
+    return length;
+}
+
+const char *command_cache_lookup(const char *name) {
+    if (length == 0) {
+        return NULL;
+    }
+    cache_entry_t *entry = find_slot(entries, capacity, name);
+    if (entry->name == NULL) {
+        return NULL;
+    }
+
+    // A command installed since in an earlier directory would now win the PATH search
+    for (unsigned i = 0; i <= entry->dir; i++) {
+        if (dir_changed(&dirs[i])) {
+            return NULL;
+        }
+    }
+    return entry->path;
+}
+
+int command_cache_refresh(void) {
+    unsigned i = 0;
+    while (i < num_dirs && !dir_changed(&dirs[i])) {
+        i++;
+    }
+    if (i == num_dirs) {
+        return length;
+    }
+
+    command_cache_clear();
+    return command_cache_warm();
+}
+
+void command_cache_clear(void) {
+    for (unsigned i = 0; i < capacity; i++) {
+        free(entries[i].name);
+        free(entries[i].path);
+    }
+    free(entries);
+    entries = NULL;
+    capacity = 0;
+    length = 0;
+
+    for (unsigned i = 0; i < num_dirs; i++) {
+        free(dirs[i].path);
+    }
+    free(dirs);
+    dirs = NULL;
+    num_dirs = 0;
+}
@@ -0,0 +1,32 @@
+#ifndef COMMAND_CACHE_H
+#define COMMAND_CACHE_H
+
+/*
+ * Index every executable in the directories on PATH, so that commands can be exec'd
+ * without searching PATH again
+ * Earlier directories take precedence, as they do for execvp()
+ * Only the absolute directories before any empty or relative PATH entry are indexed
+ * Returns the number of commands cached, or -1 on error
+ */
+int command_cache_warm(void);
+
+/*
+ * Look up the full path of a command in the cache
+ * name: The command's name, as typed (without any '/')
+ * Returns the cached path (not a copy), or NULL if the command isn't cached or the PATH
+ * directories it was looked up through have changed since
+ */
+const char *command_cache_lookup(const char *name);
+
+/*
+ * Warm the cache again if any PATH directory changed since it was last warmed
+ * Returns the number of commands cached, or -1 on error
+ */
+int command_cache_refresh(void);
+
+/*
+ * Remove all entries from the cache and free its memory
+ */
+void command_cache_clear(void);
+
+#endif    // COMMAND_CACHE_H
@@ -0,0 +1,260 @@
+#define _GNU_SOURCE
+
+#include "event_loop.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/epoll.h>
+#include <sys/signalfd.h>
+#include <sys/timerfd.h>
+#include <unistd.h>
+
+int event_loop_init(event_loop_t *loop) {
+    loop->epoll_fd = -1;
+    loop->signal_fd = -1;
+    loop->timer_fd = -1;
+    loop->input_pollable = 0;
+    loop->input_watched = 0;
+    loop->input_eof = 0;
+    loop->input_discarding = 0;
+    loop->input_len = 0;
+
+    // Block the signals we care about so they only arrive through the signalfd
+    sigset_t mask;
+    sigemptyset(&mask);
+    sigaddset(&mask, SIGCHLD);
+    sigaddset(&mask, SIGINT);
+    sigaddset(&mask, SIGTSTP);
+    if (sigprocmask(SIG_BLOCK, &mask, NULL) == -1) {
+        perror("sigprocmask");
+        return -1;
+    }
+
+    if ((loop->signal_fd = signalfd(-1, &mask, SFD_NONBLOCK | SFD_CLOEXEC)) == -1) {
+        perror("signalfd");
+        event_loop_free(loop);
+        return -1;
+    }
+    if ((loop->timer_fd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) == -1) {
+        perror("timerfd_create");
+        event_loop_free(loop);
+        return -1;
+    }
+    if ((loop->epoll_fd = epoll_create1(EPOLL_CLOEXEC)) == -1) {
+        perror("epoll_create1");
+        event_loop_free(loop);
+        return -1;
+    }
+
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = loop->signal_fd;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->signal_fd, &ev) == -1) {
+        perror("epoll_ctl");
+        event_loop_free(loop);
+        return -1;
+    }
+    ev.data.fd = loop->timer_fd;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, loop->timer_fd, &ev) == -1) {
+        perror("epoll_ctl");
+        event_loop_free(loop);
+        return -1;
+    }
+
+    // epoll refuses regular files (e.g. a script redirected to stdin), which are always readable
+    ev.data.fd = STDIN_FILENO;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, STDIN_FILENO, &ev) == 0) {
+        loop->input_pollable = 1;
+        loop->input_watched = 1;
+    } else if (errno != EPERM) {
+        perror("epoll_ctl");
+        event_loop_free(loop);
+        return -1;
+    }
+
+    return 0;
+}
+
+void event_loop_free(event_loop_t *loop) {
+    if (loop->epoll_fd != -1) {
+        close(loop->epoll_fd);
+        loop->epoll_fd = -1;
+    }
+    if (loop->signal_fd != -1) {
+        close(loop->signal_fd);
+        loop->signal_fd = -1;
+    }
+    if (loop->timer_fd != -1) {
+        close(loop->timer_fd);
+        loop->timer_fd = -1;
+    }
+}
+
+int event_loop_next(event_loop_t *loop, int watch_input) {
+    // Stdin is level-triggered, so it has to leave the set while nobody will read it
+    if (loop->input_pollable && watch_input != loop->input_watched) {
+        struct epoll_event ev;
+        ev.events = EPOLLIN;
+        ev.data.fd = STDIN_FILENO;
+        int op = watch_input ? EPOLL_CTL_ADD : EPOLL_CTL_DEL;
+        if (epoll_ctl(loop->epoll_fd, op, STDIN_FILENO, &ev) == -1) {
+            perror("epoll_ctl");
+            return -1;
+        }
+        loop->input_watched = watch_input;
+    }
+
+    // A regular file never blocks, so only check for pending signals before reading it
+    int timeout = (watch_input && !loop->input_pollable) ? 0 : -1;
+
+    while (1) {
+        struct epoll_event ev;
+        int n = epoll_wait(loop->epoll_fd, &ev, 1, timeout);
+        if (n == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("epoll_wait");
+            return -1;
+        }
+        if (n == 0) {
+            return EVENT_INPUT;
+        }
+
+        if (ev.data.fd == loop->signal_fd) {
+            struct signalfd_siginfo info;
+            if (read(loop->signal_fd, &info, sizeof(info)) != sizeof(info)) {
+                continue;
+            }
+            if (info.ssi_signo == SIGCHLD) {
+                return EVENT_SIGCHLD;
+            } else if (info.ssi_signo == SIGINT) {
+                return EVENT_SIGINT;
+            } else {
+                return EVENT_SIGTSTP;
+            }
+        } else if (ev.data.fd == loop->timer_fd) {
+            uint64_t expirations;
+            if (read(loop->timer_fd, &expirations, sizeof(expirations)) != sizeof(expirations)) {
+                continue;
+            }
+            return EVENT_TIMER;
+        } else {
+            return EVENT_INPUT;
+        }
+    }
+}
+
+int event_loop_wait_fd(event_loop_t *loop, int fd) {
+    struct epoll_event ev;
+    ev.events = EPOLLIN;
+    ev.data.fd = fd;
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_ADD, fd, &ev) == -1) {
+        perror("epoll_ctl");
+        return -1;
+    }
+
+    // Children changing state are picked up at the next prompt, so only fd and Ctrl-C matter here
+    int event;
+    do {
+        event = event_loop_next(loop, 0);
+    } while (event != EVENT_INPUT && event != EVENT_SIGINT && event != -1);
+
+    if (epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, fd, &ev) == -1) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    return event;
+}
+
+int event_loop_detach_input(event_loop_t *loop) {
+    if (loop->input_watched && epoll_ctl(loop->epoll_fd, EPOLL_CTL_DEL, STDIN_FILENO, NULL) == -1) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    loop->input_pollable = 0;
+    loop->input_watched = 0;
+    return 0;
+}
+
+int event_loop_read_input(event_loop_t *loop) {
+    if (loop->input_len == INPUT_LEN) {
+        return INPUT_LEN;
+    }
+
+    ssize_t n = read(STDIN_FILENO, loop->input + loop->input_len, INPUT_LEN - loop->input_len);
+    if (n == -1) {
+        if (errno == EINTR || errno == EAGAIN) {
+            return 0;
+        }
+        perror("read");
+        return -1;
+    }
+    if (n == 0) {
+        loop->input_eof = 1;
+    }
+    loop->input_len += n;
+    return n;
+}
+
+int event_loop_next_line(event_loop_t *loop, char *line, unsigned size) {
+    char *newline = memchr(loop->input, '\n', loop->input_len);
+
+    // Still skipping the rest of an overlong line, which may not all have arrived yet
+    if (loop->input_discarding) {
+        if (newline == NULL) {
+            loop->input_discarding = !loop->input_eof;
+            loop->input_len = 0;
+            return 0;
+        }
+        loop->input_discarding = 0;
+        loop->input_len -= newline - loop->input + 1;
+        memmove(loop->input, newline + 1, loop->input_len);
+        newline = memchr(loop->input, '\n', loop->input_len);
+    }
+
+    unsigned line_len;
+    unsigned consumed;
+    if (newline != NULL) {
+        line_len = newline - loop->input;
+        consumed = line_len + 1;
+    } else if (loop->input_len == INPUT_LEN || (loop->input_eof && loop->input_len > 0)) {
+        line_len = loop->input_len;
+        consumed = line_len;
+    } else {
+        return 0;
+    }
+
+    // Running only part of a line would run a different command, so the whole line is dropped
+    if (line_len > size - 1) {
+        loop->input_discarding = newline == NULL && !loop->input_eof;
+        loop->input_len -= consumed;
+        memmove(loop->input, loop->input + consumed, loop->input_len);
+        return -1;
+    }
+    memcpy(line, loop->input, line_len);
+    line[line_len] = '\0';
+
+    loop->input_len -= consumed;
+    memmove(loop->input, loop->input + consumed, loop->input_len);
+    return 1;
+}
+
+void event_loop_discard_input(event_loop_t *loop) {
+    loop->input_len = 0;
+    loop->input_discarding = 0;
+}
+
+int event_loop_set_timer(event_loop_t *loop, unsigned seconds) {
+    struct itimerspec spec;
+    memset(&spec, 0, sizeof(spec));
+    spec.it_value.tv_sec = seconds;
+    if (timerfd_settime(loop->timer_fd, 0, &spec, NULL) == -1) {
+        perror("timerfd_settime");
+        return -1;
+    }
+    return 0;
+}
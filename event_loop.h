@@ -0,0 +1,100 @@
+#ifndef EVENT_LOOP_H
+#define EVENT_LOOP_H
+
+#include <sys/types.h>
+
+#define INPUT_LEN 512
+
+typedef enum {
+    EVENT_INPUT,
+    EVENT_SIGCHLD,
+    EVENT_SIGINT,
+    EVENT_SIGTSTP,
+    EVENT_TIMER,
+} event_t;
+
+typedef struct {
+    int epoll_fd;
+    int signal_fd;
+    int timer_fd;
+    int input_pollable;    // 0 if stdin is a regular file, which epoll refuses
+    int input_watched;
+    int input_eof;
+    int input_discarding;    // Set while skipping the rest of a line that was too long
+    unsigned input_len;
+    char input[INPUT_LEN];
+} event_loop_t;
+
+/*
+ * Initialize the shell's event loop
+ * SIGCHLD, SIGINT and SIGTSTP are blocked and delivered through a signalfd instead,
+ * so callers must unblock them again in any child before exec
+ * loop: Pointer to the event loop to initialize
+ * Returns 0 on success or -1 on error
+ */
+int event_loop_init(event_loop_t *loop);
+
+/*
+ * Close all file descriptors owned by an event loop
+ * loop: Pointer to the event loop to free
+ */
+void event_loop_free(event_loop_t *loop);
+
+/*
+ * Block until the next event is available
+ * loop: Pointer to the event loop to wait on
+ * watch_input: Whether stdin becoming readable should be reported
+ * Returns the event_t that occurred or -1 on error
+ */
+int event_loop_next(event_loop_t *loop, int watch_input);
+
+/*
+ * Block until a file descriptor other than stdin becomes readable, or the user hits Ctrl-C
+ * loop: Pointer to the event loop to wait on
+ * fd: The file descriptor to wait for
+ * Returns EVENT_INPUT once fd is readable (or closed), EVENT_SIGINT if interrupted, or -1 on error
+ */
+int event_loop_wait_fd(event_loop_t *loop, int fd);
+
+/*
+ * Stop watching stdin for good, for a shell whose commands come from somewhere else
+ * Stdin may then be replaced (e.g. with dup2()) without confusing the loop
+ * loop: Pointer to the event loop
+ * Returns 0 on success or -1 on error
+ */
+int event_loop_detach_input(event_loop_t *loop);
+
+/*
+ * Read whatever is available on stdin into the loop's input buffer
+ * Sets input_eof once stdin has been closed
+ * loop: Pointer to the event loop to read into
+ * Returns the number of bytes read (0 on end of input) or -1 on error
+ */
+int event_loop_read_input(event_loop_t *loop);
+
+/*
+ * Extract the next complete line from the loop's input buffer
+ * Once input_eof is set, a final line without a trailing '\n' is also returned
+ * A line that doesn't fit in the line buffer is dropped up to its '\n', however long it is
+ * loop: Pointer to the event loop to take input from
+ * line: Buffer to copy the line into, without its trailing '\n'
+ * size: Size of the line buffer
+ * Returns 1 if a line was copied, -1 if an overlong line was dropped, or 0 otherwise
+ */
+int event_loop_next_line(event_loop_t *loop, char *line, unsigned size);
+
+/*
+ * Discard any partially typed input, e.g. after the user hits Ctrl-C at the prompt
+ * loop: Pointer to the event loop to reset
+ */
+void event_loop_discard_input(event_loop_t *loop);
+
+/*
+ * Arm the loop's timer so that an EVENT_TIMER is reported after a delay
+ * loop: Pointer to the event loop
+ * seconds: Delay before the timer fires, or 0 to disarm it
+ * Returns 0 on success or -1 on error
+ */
+int event_loop_set_timer(event_loop_t *loop, unsigned seconds);
+
+#endif    // EVENT_LOOP_H
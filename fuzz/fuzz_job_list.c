@@ -0,0 +1,106 @@
+/*
+ * Fuzz target for job_list
+ * Each input is decoded into a sequence of operations that are applied both to a job_list_t
+ * and to a simple model, and the two are compared after every step
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "job_list.h"
+
+#define MODEL_LEN 1024
+
+typedef enum {
+    OP_ADD,
+    OP_GET,
+    OP_REMOVE,
+    OP_REMOVE_BY_STATUS,
+    OP_FREE,
+    NUM_OPS,
+} op_t;
+
+typedef struct {
+    unsigned length;
+    pid_t pids[MODEL_LEN];
+    job_status_t statuses[MODEL_LEN];
+} model_t;
+
+static void check(const job_list_t *list, const model_t *model) {
+    if (list->length != model->length) {
+        abort();
+    }
+
+    unsigned i = 0;
+    job_t *last = NULL;
+    for (job_t *job = list->head; job != NULL; job = job->next) {
+        if (i >= model->length || job->pid != model->pids[i] || job->status != model->statuses[i]) {
+            abort();
+        }
+        last = job;
+        i++;
+    }
+    if (i != model->length || list->tail != last) {
+        abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static model_t model;
+    model.length = 0;
+    job_list_t list;
+    job_list_init(&list);
+    pid_t next_pid = 1;
+
+    size_t pos = 0;
+    while (pos < size) {
+        op_t op = data[pos++] % NUM_OPS;
+        uint8_t arg = pos < size ? data[pos++] : 0;
+        job_status_t status = arg & 1 ? BACKGROUND : STOPPED;
+
+        if (op == OP_ADD && model.length < MODEL_LEN) {
+            if (job_list_add(&list, next_pid, "job", status) != 0) {
+                abort();
+            }
+            model.pids[model.length] = next_pid++;
+            model.statuses[model.length++] = status;
+        } else if (op == OP_GET) {
+            job_t *job = job_list_get(&list, arg);
+            if (arg < model.length ? job == NULL || job->pid != model.pids[arg] : job != NULL) {
+                abort();
+            }
+        } else if (op == OP_REMOVE) {
+            int ret = job_list_remove(&list, arg);
+            if (arg < model.length) {
+                if (ret != 0) {
+                    abort();
+                }
+                model.length--;
+                memmove(model.pids + arg, model.pids + arg + 1,
+                        (model.length - arg) * sizeof(pid_t));
+                memmove(model.statuses + arg, model.statuses + arg + 1,
+                        (model.length - arg) * sizeof(job_status_t));
+            } else if (ret != -1) {
+                abort();
+            }
+        } else if (op == OP_REMOVE_BY_STATUS) {
+            job_list_remove_by_status(&list, status);
+            unsigned kept = 0;
+            for (unsigned i = 0; i < model.length; i++) {
+                if (model.statuses[i] != status) {
+                    model.pids[kept] = model.pids[i];
+                    model.statuses[kept++] = model.statuses[i];
+                }
+            }
+            model.length = kept;
+        } else if (op == OP_FREE) {
+            job_list_free(&list);
+            model.length = 0;
+        }
+        check(&list, &model);
+    }
+
+    job_list_free(&list);
+    return 0;
+}
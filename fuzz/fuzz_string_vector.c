@@ -0,0 +1,108 @@
+/*
+ * Fuzz target for string_vector
+ * Each input is decoded into a sequence of operations that are applied both to a strvec_t
+ * and to a simple model, and the two are compared after every step
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "string_vector.h"
+
+#define MODEL_LEN 1024
+#define MAX_STR_LEN 16
+
+typedef enum {
+    OP_ADD,
+    OP_GET,
+    OP_FIND,
+    OP_TAKE,
+    OP_DROP,
+    OP_CLEAR,
+    NUM_OPS,
+} op_t;
+
+typedef struct {
+    unsigned length;
+    char data[MODEL_LEN][MAX_STR_LEN + 1];
+} model_t;
+
+static void check(const strvec_t *vec, const model_t *model) {
+    if (vec->length != model->length || vec->length > vec->capacity) {
+        abort();
+    }
+    for (unsigned i = 0; i < model->length; i++) {
+        if (strcmp(strvec_get(vec, i), model->data[i]) != 0) {
+            abort();
+        }
+    }
+    if (strvec_get(vec, model->length) != NULL) {
+        abort();
+    }
+}
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    static model_t model;
+    model.length = 0;
+    strvec_t vec;
+    strvec_init(&vec);
+
+    size_t pos = 0;
+    while (pos < size) {
+        op_t op = data[pos++] % NUM_OPS;
+        uint8_t arg = pos < size ? data[pos++] : 0;
+
+        if (op == OP_ADD && model.length < MODEL_LEN) {
+            // Short strings over a tiny alphabet so that finds regularly hit duplicates
+            unsigned len = arg % (MAX_STR_LEN + 1);
+            char s[MAX_STR_LEN + 1];
+            for (unsigned i = 0; i < len; i++) {
+                s[i] = 'a' + (pos < size ? data[pos++] : 0) % 3;
+            }
+            s[len] = '\0';
+            if (strvec_add(&vec, s) != 0) {
+                abort();
+            }
+            strcpy(model.data[model.length++], s);
+        } else if (op == OP_GET) {
+            char *s = strvec_get(&vec, arg);
+            if ((arg < model.length) != (s != NULL)) {
+                abort();
+            }
+        } else if (op == OP_FIND) {
+            const char *s = model.length > 0 ? model.data[arg % model.length] : "";
+            int expected = -1;
+            for (unsigned i = 0; i < model.length; i++) {
+                if (strcmp(model.data[i], s) == 0) {
+                    expected = i;
+                    break;
+                }
+            }
+            if (strvec_find(&vec, s) != expected) {
+                abort();
+            }
+        } else if (op == OP_TAKE) {
+            strvec_take(&vec, arg);
+            if (arg < model.length) {
+                model.length = arg;
+            }
+        } else if (op == OP_DROP) {
+            unsigned n = arg % 4;
+            strvec_drop(&vec, n);
+            if (n > model.length) {
+                n = model.length;
+            }
+            memmove(model.data, model.data + n, (model.length - n) * sizeof(model.data[0]));
+            model.length -= n;
+        } else if (op == OP_CLEAR) {
+            // Cleared vectors must be usable again without strvec_init()
+            strvec_clear(&vec);
+            model.length = 0;
+        }
+        check(&vec, &model);
+    }
+
+    strvec_clear(&vec);
+    return 0;
+}
@@ -0,0 +1,51 @@
+/*
+ * Fuzz target for tokenize()
+ * Checks that every token is non-empty, free of spaces and appears in the input in order
+ */
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "bash_funcs.h"
+#include "string_vector.h"
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size) {
+    // tokenize() works in place on a NUL-terminated command line
+    char *cmd = malloc(size + 1);
+    char *orig = malloc(size + 1);
+    if (cmd == NULL || orig == NULL) {
+        free(cmd);
+        free(orig);
+        return 0;
+    }
+    memcpy(cmd, data, size);
+    cmd[size] = '\0';
+    memcpy(orig, cmd, size + 1);
+
+    strvec_t tokens;
+    strvec_init(&tokens);
+    if (tokenize(cmd, &tokens) != 0) {
+        abort();
+    }
+
+    const char *rest = orig;
+    for (unsigned i = 0; i < tokens.length; i++) {
+        const char *token = strvec_get(&tokens, i);
+        if (token == NULL || token[0] == '\0' || strchr(token, ' ') != NULL) {
+            abort();
+        }
+        if ((rest = strstr(rest, token)) == NULL) {
+            abort();
+        }
+        rest += strlen(token);
+    }
+    if (strvec_get(&tokens, tokens.length) != NULL) {
+        abort();
+    }
+
+    strvec_clear(&tokens);
+    free(cmd);
+    free(orig);
+    return 0;
+}
@@ -0,0 +1,45 @@
+/*
+ * Driver for building the fuzz targets without libFuzzer, e.g. with afl-clang-fast or to replay
+ * a corpus under gcc's sanitizers
+ * Each file named on the command line is run as one input; with no arguments, stdin is
+ */
+
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+
+#define MAX_INPUT_LEN (1 << 20)
+
+int LLVMFuzzerTestOneInput(const uint8_t *data, size_t size);
+
+static int run_file(FILE *f) {
+    uint8_t *data = malloc(MAX_INPUT_LEN);
+    if (data == NULL) {
+        perror("malloc");
+        return -1;
+    }
+    size_t size = fread(data, 1, MAX_INPUT_LEN, f);
+    LLVMFuzzerTestOneInput(data, size);
+    free(data);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (argc == 1) {
+        return run_file(stdin) == -1;
+    }
+
+    for (int i = 1; i < argc; i++) {
+        FILE *f;
+        if ((f = fopen(argv[i], "rb")) == NULL) {
+            perror(argv[i]);
+            return 1;
+        }
+        int ret = run_file(f);
+        fclose(f);
+        if (ret == -1) {
+            return 1;
+        }
+    }
+    return 0;
+}
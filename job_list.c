@@ -3,9 +3,22 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/types.h>
+#include <unistd.h>
+
+/*
+ * Free a job, closing its coprocess socket if it has one
+ */
+static void free_job(job_t *job) {
+    if (job->coproc != NULL) {
+        close(job->coproc->fd);
+        free(job->coproc);
+    }
+    free(job);
+}
 
 void job_list_init(job_list_t *list) {
     list->head = NULL;
+    list->tail = NULL;
     list->length = 0;
 }
 
@@ -14,39 +27,49 @@ void job_list_free(job_list_t *list) {
     while (current != NULL) {
         job_t *temp = current;
         current = current->next;
-        free(temp);
+        free_job(temp);
     }
     list->head = NULL;
+    list->tail = NULL;
     list->length = 0;
 }
 
 int job_list_add(job_list_t *list, pid_t pid, const char *name, job_status_t status) {
+    job_t *job;
+    if ((job = malloc(sizeof(job_t))) == NULL) {
+        return -1;
+    }
+    strncpy(job->name, name, NAME_LEN);
+    job->name[NAME_LEN - 1] = '\0';
+    job->status = status;
+    job->coproc = NULL;
+    job->next = NULL;
+    job->pid = pid;
+
     if (list->head == NULL) {
-        if ((list->head = malloc(sizeof(job_t))) == NULL) {
-            return -1;
-        }
-        strncpy(list->head->name, name, NAME_LEN);
-        list->head->name[NAME_LEN - 1] = '\0';
-        list->head->status = status;
-        list->head->next = NULL;
-        list->head->pid = pid;
-        list->length = 1;
-        return 0;
+        list->head = job;
+    } else {
+        list->tail->next = job;
     }
+    list->tail = job;
+    list->length++;
+    return 0;
+}
 
-    job_t *current = list->head;
-    while (current->next != NULL) {
-        current = current->next;
+int job_list_add_coproc(job_list_t *list, pid_t pid, const char *name, int fd) {
+    coproc_t *coproc;
+    if ((coproc = malloc(sizeof(coproc_t))) == NULL) {
+        return -1;
     }
-    if ((current->next = malloc(sizeof(job_t))) == NULL) {
+    coproc->fd = fd;
+    coproc->exited = 0;
+    coproc->buf_len = 0;
+
+    if (job_list_add(list, pid, name, COPROC) == -1) {
+        free(coproc);
         return -1;
     }
-    strncpy(current->next->name, name, NAME_LEN);
-    current->next->name[NAME_LEN - 1] = '\0';
-    current->next->status = status;
-    current->next->next = NULL;
-    current->next->pid = pid;
-    list->length++;
+    list->tail->coproc = coproc;
     return 0;
 }
 
@@ -56,7 +79,7 @@ job_t *job_list_get(job_list_t *list, unsigned idx) {
     }
 
     job_t *current = list->head;
-    for (int i = 0; i < idx; i++) {
+    for (unsigned i = 0; i < idx; i++) {
         if (current == NULL) {
             return NULL;
         }
@@ -65,6 +88,15 @@ job_t *job_list_get(job_list_t *list, unsigned idx) {
     return current;
 }
 
+job_t *job_list_find(job_list_t *list, const char *name, job_status_t status) {
+    for (job_t *current = list->head; current != NULL; current = current->next) {
+        if (current->status == status && strcmp(current->name, name) == 0) {
+            return current;
+        }
+    }
+    return NULL;
+}
+
 int job_list_remove(job_list_t *list, unsigned idx) {
     if (idx >= list->length) {
         return -1;
@@ -73,18 +105,24 @@ int job_list_remove(job_list_t *list, unsigned idx) {
     if (idx == 0) {
         job_t *temp = list->head;
         list->head = list->head->next;
-        free(temp);
+        if (list->head == NULL) {
+            list->tail = NULL;
+        }
+        free_job(temp);
         list->length--;
         return 0;
     }
 
     job_t *current = list->head;
-    for (int i = 0; i < idx - 1; i++) {
+    for (unsigned i = 0; i < idx - 1; i++) {
         current = current->next;
     }
     job_t *temp = current->next;
     current->next = current->next->next;
-    free(temp);
+    if (current->next == NULL) {
+        list->tail = current;
+    }
+    free_job(temp);
     list->length--;
     return 0;
 }
@@ -94,20 +132,24 @@ void job_list_remove_by_status(job_list_t *list, job_status_t status) {
         job_t *temp = list->head;
         list->head = list->head->next;
         list->length--;
-        free(temp);
-    }
-
-    if (list->head != NULL) {    // Could have removed all nodes in loop above
-        job_t *current = list->head;
-        while (current->next != NULL) {
-            if (current->next->status == status) {
-                job_t *temp = current->next;
-                current->next = current->next->next;
-                list->length--;
-                free(temp);
-            } else {
-                current = current->next;
-            }
+        free_job(temp);
+    }
+
+    if (list->head == NULL) {    // Could have removed all nodes in loop above
+        list->tail = NULL;
+        return;
+    }
+
+    job_t *current = list->head;
+    while (current->next != NULL) {
+        if (current->next->status == status) {
+            job_t *temp = current->next;
+            current->next = current->next->next;
+            list->length--;
+            free_job(temp);
+        } else {
+            current = current->next;
         }
     }
+    list->tail = current;
 }
@@ -5,21 +5,32 @@
 #include <sys/types.h>
 
 #define NAME_LEN 32
+#define COPROC_BUF_LEN 4096
 
 typedef enum {
     STOPPED,
     BACKGROUND,
+    COPROC,
 } job_status_t;
 
+typedef struct {
+    int fd;    // Our end of a socketpair connected to the coprocess's stdin and stdout
+    int exited;    // Set once reaped while output was still unread
+    unsigned buf_len;
+    char buf[COPROC_BUF_LEN];    // Output read from the coprocess but not yet consumed
+} coproc_t;
+
 typedef struct job {
     char name[NAME_LEN];
     int status;
     pid_t pid;
+    coproc_t *coproc;    // NULL unless status is COPROC
     struct job *next;
 } job_t;
 
 typedef struct {
     job_t *head;
+    job_t *tail;    // Kept so that adding a job doesn't walk the whole list
     unsigned length;
 } job_list_t;
 
@@ -46,6 +57,17 @@ void job_list_free(job_list_t *list);
  */
 int job_list_add(job_list_t *list, pid_t pid, const char *name, job_status_t status);
 
+/*
+ * Add a new coprocess to a jobs list
+ * The list takes ownership of fd and closes it when the job is removed
+ * list: The jobs list to add to
+ * pid: The process ID of the coprocess
+ * name: The name the coprocess was started under
+ * fd: The shell's end of the socket connected to the coprocess's stdin and stdout
+ * Returns 0 on success or -1 on error
+ */
+int job_list_add_coproc(job_list_t *list, pid_t pid, const char *name, int fd);
+
 /*
  * Retrieve an element from a jobs list
  * list: Pointer to the jobs list to retrieve from
@@ -54,6 +76,15 @@ int job_list_add(job_list_t *list, pid_t pid, const char *name, job_status_t sta
  */
 job_t *job_list_get(job_list_t *list, unsigned idx);
 
+/*
+ * Find a job by name
+ * list: Pointer to the jobs list to search within
+ * name: Name of the job to search for
+ * status: Only jobs with this status are considered
+ * Returns a pointer to the first matching job_t (not a copy), or NULL if not found
+ */
+job_t *job_list_find(job_list_t *list, const char *name, job_status_t status);
+
 /*
  * Removes an element at a specific index from a jobs list
  * The memory for this element is freed
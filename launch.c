@@ -0,0 +1,620 @@
+#define _GNU_SOURCE
+
+#include "launch.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <sched.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#include "string_vector.h"
+
+#define SHELL_CGROUP "shell"    // Leaf the shell moves into so its cgroup can enable controllers
+
+// glibc has no wrapper for ioprio_set(), so these come from linux/ioprio.h
+#define IOPRIO_WHO_PROCESS 1
+#define IOPRIO_CLASS_BE 2
+#define IOPRIO_CLASS_SHIFT 13
+
+typedef struct {
+    char flag;
+    int resource;
+    rlim_t unit;
+    const char *desc;
+} limit_desc_t;
+
+static const limit_desc_t limit_descs[] = {
+    {'c', RLIMIT_CORE, 1024, "core file size (KB)"},
+    {'d', RLIMIT_DATA, 1024, "data seg size (KB)"},
+    {'f', RLIMIT_FSIZE, 1024, "file size (KB)"},
+    {'n', RLIMIT_NOFILE, 1, "open files"},
+    {'s', RLIMIT_STACK, 1024, "stack size (KB)"},
+    {'t', RLIMIT_CPU, 1, "cpu time (seconds)"},
+    {'u', RLIMIT_NPROC, 1, "max user processes"},
+    {'v', RLIMIT_AS, 1024, "virtual memory (KB)"},
+};
+
+#define NUM_LIMITS (sizeof(limit_descs) / sizeof(limit_descs[0]))
+
+// The cgroup v2 directory the shell started in, found the first time a job asks for a cgroup
+static char cgroup_parent[PATH_MAX];
+
+// Job cgroups created by this shell, which are removed again once their jobs are gone
+static strvec_t created_cgroups;
+
+void launch_opts_init(launch_opts_t *opts) {
+    opts->own_process_group = 1;
+    opts->has_cpus = 0;
+    CPU_ZERO(&opts->cpus);
+    opts->has_nice = 0;
+    opts->nice = 0;
+    opts->has_io_priority = 0;
+    opts->io_priority = 0;
+    opts->mem_bytes = 0;
+    opts->cgroup[0] = '\0';
+}
+
+/*
+ * Parse a CPU list such as "0-3,6" into a CPU set
+ * Returns 0 on success or -1 on error
+ */
+static int parse_cpu_list(const char *s, cpu_set_t *cpus) {
+    CPU_ZERO(cpus);
+    while (*s != '\0') {
+        char *end;
+        long first = strtol(s, &end, 10);
+        long last = first;
+        if (end == s || first < 0) {
+            return -1;
+        }
+        if (*end == '-') {
+            s = end + 1;
+            last = strtol(s, &end, 10);
+            if (end == s || last < first) {
+                return -1;
+            }
+        }
+        if (last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            CPU_SET(cpu, cpus);
+        }
+
+        if (*end == ',') {
+            end++;
+        } else if (*end != '\0') {
+            return -1;
+        }
+        s = end;
+    }
+    return 0;
+}
+
+/*
+ * Parse a size such as "512M" into a number of bytes (K, M and G suffixes are accepted)
+ * Returns 0 on success or -1 on error
+ */
+static int parse_size(const char *s, rlim_t *bytes) {
+    char *end;
+    errno = 0;
+    unsigned long long value = strtoull(s, &end, 10);
+    if (end == s || errno != 0 || value == 0) {
+        return -1;
+    }
+
+    unsigned shift = 0;
+    if (*end == 'K' || *end == 'k') {
+        shift = 10;
+        end++;
+    } else if (*end == 'M' || *end == 'm') {
+        shift = 20;
+        end++;
+    } else if (*end == 'G' || *end == 'g') {
+        shift = 30;
+        end++;
+    }
+    // A size that wraps around, or reaches RLIM_INFINITY, would end up meaning "unlimited"
+    if (*end != '\0' || value > (RLIM_INFINITY - 1) >> shift) {
+        return -1;
+    }
+    value <<= shift;
+
+    *bytes = value;
+    return 0;
+}
+
+/*
+ * Parse a whole string as an integer between min and max
+ * Returns 0 on success or -1 on error
+ */
+static int parse_int(const char *s, long min, long max, int *value) {
+    char *end;
+    errno = 0;
+    long parsed = strtol(s, &end, 10);
+    if (end == s || *end != '\0' || errno != 0 || parsed < min || parsed > max) {
+        return -1;
+    }
+    *value = parsed;
+    return 0;
+}
+
+int launch_opts_parse(strvec_t *tokens, launch_opts_t *opts) {
+    launch_opts_init(opts);
+
+    // Options come in "--name value" pairs until the first token of the command itself
+    unsigned i = 1;
+    const char *option;
+    while ((option = strvec_get(tokens, i)) != NULL && strncmp(option, "--", 2) == 0) {
+        const char *value = strvec_get(tokens, i + 1);
+        if (value == NULL) {
+            fprintf(stderr, "run: %s needs a value\n", option);
+            return -1;
+        }
+
+        if (strcmp(option, "--cpus") == 0) {
+            if (parse_cpu_list(value, &opts->cpus) == -1) {
+                fprintf(stderr, "run: invalid CPU list '%s'\n", value);
+                return -1;
+            }
+            opts->has_cpus = 1;
+        } else if (strcmp(option, "--mem") == 0) {
+            if (parse_size(value, &opts->mem_bytes) == -1) {
+                fprintf(stderr, "run: invalid memory size '%s'\n", value);
+                return -1;
+            }
+        } else if (strcmp(option, "--nice") == 0) {
+            if (parse_int(value, -20, 19, &opts->nice) == -1) {
+                fprintf(stderr, "run: nice value must be between -20 and 19\n");
+                return -1;
+            }
+            opts->has_nice = 1;
+        } else if (strcmp(option, "--io") == 0) {
+            if (parse_int(value, 0, 7, &opts->io_priority) == -1) {
+                fprintf(stderr, "run: I/O priority must be between 0 and 7\n");
+                return -1;
+            }
+            opts->has_io_priority = 1;
+        } else if (strcmp(option, "--cgroup") == 0) {
+            if (strlen(value) >= CGROUP_NAME_LEN || strchr(value, '/') != NULL ||
+                strcmp(value, ".") == 0 || strcmp(value, "..") == 0 ||
+                strcmp(value, SHELL_CGROUP) == 0) {
+                fprintf(stderr, "run: invalid cgroup name '%s'\n", value);
+                return -1;
+            }
+            strcpy(opts->cgroup, value);
+        } else {
+            fprintf(stderr, "run: unknown option %s\n", option);
+            return -1;
+        }
+        i += 2;
+    }
+
+    if (i >= tokens->length) {
+        fprintf(stderr, "run: missing command\n");
+        return -1;
+    }
+    strvec_drop(tokens, i);
+    return 0;
+}
+
+/*
+ * Write a string to a cgroup interface file
+ * Returns 0 on success or -1 on error
+ */
+static int write_cgroup_file(const char *dir, const char *file, const char *value) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s", dir, file) >= sizeof(path)) {
+        fprintf(stderr, "run: cgroup path too long\n");
+        return -1;
+    }
+
+    int fd;
+    if ((fd = open(path, O_WRONLY | O_CLOEXEC)) == -1) {
+        perror(path);
+        return -1;
+    }
+    if (write(fd, value, strlen(value)) == -1) {
+        perror(path);
+        close(fd);
+        return -1;
+    }
+    if (close(fd) == -1) {
+        perror("close");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Find where the cgroup v2 hierarchy is mounted: /sys/fs/cgroup on a unified host,
+ * but e.g. /sys/fs/cgroup/unified on a hybrid one, where /sys/fs/cgroup is a tmpfs
+ * mount_point: Buffer of PATH_MAX bytes for the mount point
+ * root: Buffer of PATH_MAX bytes for the cgroup mounted there (normally "/")
+ * Returns 0 on success or -1 on error
+ */
+static int find_cgroup2_mount(char *mount_point, char *root) {
+    FILE *f;
+    if ((f = fopen("/proc/self/mountinfo", "r")) == NULL) {
+        perror("/proc/self/mountinfo");
+        return -1;
+    }
+
+    // Lines read "ID PARENT MAJOR:MINOR ROOT MOUNT_POINT OPTIONS [TAGS...] - FSTYPE SOURCE OPTIONS"
+    char line[2 * PATH_MAX];
+    int found = 0;
+    while (!found && fgets(line, sizeof(line), f) != NULL) {
+        char *separator = strstr(line, " - ");
+        found = separator != NULL && strncmp(separator + 3, "cgroup2 ", 8) == 0 &&
+                sscanf(line, "%*s %*s %*s %4095s %4095s", root, mount_point) == 2;
+    }
+    fclose(f);
+
+    if (!found) {
+        fprintf(stderr, "run: cgroup v2 is not mounted\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Work out the directory of the cgroup the shell started in, on first use
+ * Returns 0 on success or -1 on error
+ */
+static int find_cgroup_parent(void) {
+    if (cgroup_parent[0] != '\0') {
+        return 0;
+    }
+
+    char mount_point[PATH_MAX];
+    char root[PATH_MAX];
+    if (find_cgroup2_mount(mount_point, root) == -1) {
+        return -1;
+    }
+
+    // Our place in the v2 hierarchy is the "0::" line of /proc/self/cgroup
+    FILE *f;
+    if ((f = fopen("/proc/self/cgroup", "r")) == NULL) {
+        perror("/proc/self/cgroup");
+        return -1;
+    }
+    char line[PATH_MAX];
+    char *current = NULL;
+    while (fgets(line, sizeof(line), f) != NULL) {
+        if (strncmp(line, "0::", 3) == 0) {
+            current = line + 3;
+            current[strcspn(current, "\n")] = '\0';
+            break;
+        }
+    }
+    fclose(f);
+    if (current == NULL) {
+        fprintf(stderr, "run: the shell is not in a cgroup v2 hierarchy\n");
+        return -1;
+    }
+
+    // The mount may only expose a subtree, in which case our path is relative to its root
+    size_t root_len = strlen(root);
+    if (strcmp(root, "/") != 0 && strncmp(current, root, root_len) == 0) {
+        current += root_len;
+    }
+    if (strcmp(current, "/") == 0) {
+        current = "";
+    }
+
+    char dir[PATH_MAX];
+    if (snprintf(dir, sizeof(dir), "%s%s", mount_point, current) >= sizeof(dir)) {
+        fprintf(stderr, "run: cgroup path too long\n");
+        return -1;
+    }
+    if (access(dir, W_OK) == -1) {
+        perror(dir);
+        return -1;
+    }
+    strcpy(cgroup_parent, dir);
+    return 0;
+}
+
+/*
+ * Build the directory of a job cgroup, which lives next to the shell's own
+ * Returns 0 on success or -1 on error
+ */
+static int job_cgroup_dir(const char *name, char *dir) {
+    if (snprintf(dir, PATH_MAX, "%s/%s", cgroup_parent, name) >= PATH_MAX) {
+        fprintf(stderr, "run: cgroup path too long\n");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Check whether a controller is listed in a cgroup's cgroup.controllers
+ * Returns 1 if it is, 0 if it isn't, or -1 on error
+ */
+static int cgroup_has_controller(const char *dir, const char *controller) {
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/cgroup.controllers", dir) >= sizeof(path)) {
+        fprintf(stderr, "run: cgroup path too long\n");
+        return -1;
+    }
+
+    FILE *f;
+    if ((f = fopen(path, "r")) == NULL) {
+        perror(path);
+        return -1;
+    }
+    char line[PATH_MAX];
+    int found = 0;
+    if (fgets(line, sizeof(line), f) != NULL) {
+        char *saveptr;
+        for (char *name = strtok_r(line, " \n", &saveptr); name != NULL && !found;
+             name = strtok_r(NULL, " \n", &saveptr)) {
+            found = strcmp(name, controller) == 0;
+        }
+    }
+    fclose(f);
+    return found;
+}
+
+/*
+ * Make the memory controller available to job cgroups
+ * cgroup v2 only enables controllers for the children of a cgroup without processes of its
+ * own, so the shell first moves out of the way into a leaf cgroup
+ * Returns 0 on success or -1 on error
+ */
+static int enable_memory_controller(void) {
+    static int enabled = 0;
+    if (enabled) {
+        return 0;
+    }
+
+    int available;
+    if ((available = cgroup_has_controller(cgroup_parent, "memory")) == -1) {
+        return -1;
+    } else if (!available) {
+        fprintf(stderr, "run: the memory controller is not available in %s\n", cgroup_parent);
+        return -1;
+    }
+
+    char leaf[PATH_MAX];
+    if (job_cgroup_dir(SHELL_CGROUP, leaf) == -1) {
+        return -1;
+    }
+    int created = mkdir(leaf, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) == 0;
+    if (!created && errno != EEXIST) {
+        perror(leaf);
+        return -1;
+    }
+    // Writing "0" moves the writing process itself
+    if (write_cgroup_file(leaf, "cgroup.procs", "0") == -1) {
+        return -1;
+    }
+
+    if (write_cgroup_file(cgroup_parent, "cgroup.subtree_control", "+memory") == -1) {
+        // Other processes share the shell's cgroup, so put everything back as it was
+        fprintf(stderr, "run: --mem needs the shell started in a cgroup of its own, "
+                        "e.g. with systemd-run --user --scope -p Delegate=yes\n");
+        if (write_cgroup_file(cgroup_parent, "cgroup.procs", "0") == 0 && created) {
+            rmdir(leaf);
+        }
+        return -1;
+    }
+    enabled = 1;
+    return 0;
+}
+
+int launch_opts_prepare(const launch_opts_t *opts) {
+    if (opts->cgroup[0] == '\0') {
+        return 0;
+    }
+    if (find_cgroup_parent() == -1) {
+        return -1;
+    }
+    if (opts->mem_bytes != 0 && enable_memory_controller() == -1) {
+        return -1;
+    }
+
+    char dir[PATH_MAX];
+    if (job_cgroup_dir(opts->cgroup, dir) == -1) {
+        return -1;
+    }
+    if (mkdir(dir, S_IRWXU | S_IRGRP | S_IXGRP | S_IROTH | S_IXOTH) == 0) {
+        // Only cgroups we created get removed later, never ones that were already there
+        if (strvec_add(&created_cgroups, opts->cgroup) == -1) {
+            fprintf(stderr, "run: failed to record cgroup %s\n", opts->cgroup);
+            rmdir(dir);
+            return -1;
+        }
+    } else if (errno != EEXIST) {
+        perror(dir);
+        return -1;
+    }
+
+    if (opts->mem_bytes != 0) {
+        char value[32];
+        snprintf(value, sizeof(value), "%llu", (unsigned long long) opts->mem_bytes);
+        if (write_cgroup_file(dir, "memory.max", value) == -1) {
+            return -1;
+        }
+    }
+    return 0;
+}
+
+void launch_opts_place(const launch_opts_t *opts, pid_t pid) {
+    if (opts->cgroup[0] == '\0') {
+        return;
+    }
+
+    // Errors are left to the child, which joins the cgroup itself and reports them,
+    // and a child that already exited has nothing left to move
+    char path[PATH_MAX];
+    if (snprintf(path, sizeof(path), "%s/%s/cgroup.procs", cgroup_parent, opts->cgroup) >=
+        sizeof(path)) {
+        return;
+    }
+    int fd;
+    if ((fd = open(path, O_WRONLY | O_CLOEXEC)) == -1) {
+        return;
+    }
+    char value[16];
+    snprintf(value, sizeof(value), "%d", pid);
+    ssize_t written = write(fd, value, strlen(value));
+    (void) written;
+    close(fd);
+}
+
+void launch_cgroups_cleanup(void) {
+    if (created_cgroups.length == 0) {
+        return;
+    }
+
+    // rmdir() fails with EBUSY while a cgroup still has a running or stopped job in it
+    strvec_t busy;
+    strvec_init(&busy);
+    for (unsigned i = 0; i < created_cgroups.length; i++) {
+        const char *name = strvec_get(&created_cgroups, i);
+        char dir[PATH_MAX];
+        if (job_cgroup_dir(name, dir) == 0 && rmdir(dir) == -1 && errno == EBUSY &&
+            strvec_add(&busy, name) == -1) {
+            fprintf(stderr, "run: lost track of cgroup %s\n", name);
+        }
+    }
+    strvec_clear(&created_cgroups);
+    created_cgroups = busy;
+}
+
+int launch_opts_apply(const launch_opts_t *opts) {
+    if (opts->cgroup[0] != '\0') {
+        // launch_opts_prepare() already created the cgroup, so all that's left is to join it
+        char dir[PATH_MAX];
+        if (job_cgroup_dir(opts->cgroup, dir) == -1 ||
+            write_cgroup_file(dir, "cgroup.procs", "0") == -1) {
+            return -1;
+        }
+    } else if (opts->mem_bytes != 0) {
+        // Without a cgroup, the closest per-process memory cap is the address space limit
+        struct rlimit limit;
+        limit.rlim_cur = opts->mem_bytes;
+        limit.rlim_max = opts->mem_bytes;
+        if (setrlimit(RLIMIT_AS, &limit) == -1) {
+            perror("setrlimit");
+            return -1;
+        }
+    }
+
+    if (opts->has_cpus && sched_setaffinity(0, sizeof(opts->cpus), &opts->cpus) == -1) {
+        perror("sched_setaffinity");
+        return -1;
+    }
+
+    if (opts->has_nice && setpriority(PRIO_PROCESS, 0, opts->nice) == -1) {
+        perror("setpriority");
+        return -1;
+    }
+
+    if (opts->has_io_priority) {
+        int ioprio = (IOPRIO_CLASS_BE << IOPRIO_CLASS_SHIFT) | opts->io_priority;
+        if (syscall(SYS_ioprio_set, IOPRIO_WHO_PROCESS, 0, ioprio) == -1) {
+            perror("ioprio_set");
+            return -1;
+        }
+    }
+
+    return 0;
+}
+
+/*
+ * Print a single limit in the units used by the ulimit builtin
+ */
+static void print_limit(const limit_desc_t *desc, int show_desc) {
+    struct rlimit limit;
+    if (getrlimit(desc->resource, &limit) == -1) {
+        perror("getrlimit");
+        return;
+    }
+
+    if (show_desc) {
+        printf("%-24s (-%c) ", desc->desc, desc->flag);
+    }
+    if (limit.rlim_cur == RLIM_INFINITY) {
+        printf("unlimited\n");
+    } else {
+        printf("%llu\n", (unsigned long long) (limit.rlim_cur / desc->unit));
+    }
+}
+
+int set_resource_limit(strvec_t *tokens) {
+    const char *flag_token = strvec_get(tokens, 1);
+    const char *value_token = strvec_get(tokens, 2);
+
+    // Like other shells, a bare "ulimit" refers to the file size limit
+    char flag = 'f';
+    if (flag_token != NULL) {
+        if (flag_token[0] != '-' || strlen(flag_token) != 2) {
+            if (value_token != NULL) {
+                fprintf(stderr, "ulimit: invalid option %s\n", flag_token);
+                return -1;
+            }
+            value_token = flag_token;
+        } else {
+            flag = flag_token[1];
+        }
+    }
+
+    if (flag == 'a') {
+        for (int i = 0; i < NUM_LIMITS; i++) {
+            print_limit(&limit_descs[i], 1);
+        }
+        return 0;
+    }
+
+    const limit_desc_t *desc = NULL;
+    for (int i = 0; i < NUM_LIMITS; i++) {
+        if (limit_descs[i].flag == flag) {
+            desc = &limit_descs[i];
+            break;
+        }
+    }
+    if (desc == NULL) {
+        fprintf(stderr, "ulimit: invalid option -%c\n", flag);
+        return -1;
+    }
+
+    if (value_token == NULL) {
+        print_limit(desc, 0);
+        return 0;
+    }
+
+    struct rlimit limit;
+    if (getrlimit(desc->resource, &limit) == -1) {
+        perror("getrlimit");
+        return -1;
+    }
+    if (strcmp(value_token, "unlimited") == 0) {
+        limit.rlim_cur = RLIM_INFINITY;
+    } else {
+        char *end;
+        errno = 0;
+        unsigned long long value = strtoull(value_token, &end, 10);
+        if (end == value_token || *end != '\0' || errno != 0 ||
+            value > (RLIM_INFINITY - 1) / desc->unit) {
+            fprintf(stderr, "ulimit: invalid limit '%s'\n", value_token);
+            return -1;
+        }
+        limit.rlim_cur = value * desc->unit;
+    }
+
+    // Only the soft limit moves, so it can later be raised again up to the hard limit
+    if (setrlimit(desc->resource, &limit) == -1) {
+        perror("setrlimit");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,79 @@
+#ifndef LAUNCH_H
+#define LAUNCH_H
+
+#include <sched.h>
+#include <sys/resource.h>
+#include <sys/types.h>
+
+#include "string_vector.h"
+
+#define CGROUP_NAME_LEN 64
+
+typedef struct {
+    int own_process_group;    // 0 when the command replaces the shell in its current job
+    int has_cpus;
+    cpu_set_t cpus;
+    int has_nice;
+    int nice;
+    int has_io_priority;
+    int io_priority;
+    rlim_t mem_bytes;    // 0 if unlimited
+    char cgroup[CGROUP_NAME_LEN];    // Empty if the job stays in the shell's cgroup
+} launch_opts_t;
+
+/*
+ * Initialize a set of launch options that leaves a job exactly as the shell started it
+ * opts: Pointer to the launch options to initialize
+ */
+void launch_opts_init(launch_opts_t *opts);
+
+/*
+ * Parse a "run [--cpus LIST] [--mem SIZE] [--nice N] [--io N] [--cgroup NAME] COMMAND..." prefix
+ * The "run" token and its options are removed, leaving only the command in tokens
+ * tokens: The command's tokens, starting with "run"
+ * opts: Pointer to the launch options to fill in
+ * Returns 0 on success or -1 on error
+ */
+int launch_opts_parse(strvec_t *tokens, launch_opts_t *opts);
+
+/*
+ * Set up anything a job's launch options need outside of the job itself
+ * For --cgroup, this creates the job's cgroup next to the shell's and sets its memory limit
+ * Meant to be called by the shell before it forks the job
+ * opts: The launch options to prepare for
+ * Returns 0 on success or -1 on error
+ */
+int launch_opts_prepare(const launch_opts_t *opts);
+
+/*
+ * Apply launch options to the calling process
+ * Meant to be called in a freshly forked child, right before exec
+ * opts: The launch options to apply
+ * Returns 0 on success or -1 on error
+ */
+int launch_opts_apply(const launch_opts_t *opts);
+
+/*
+ * Move a freshly forked job into its cgroup from the shell's side
+ * The child joins on its own as well, but doing both means the shell never sees the cgroup
+ * empty (and removes it) before the child got around to joining
+ * opts: The job's launch options
+ * pid: The job's process ID
+ */
+void launch_opts_place(const launch_opts_t *opts, pid_t pid);
+
+/*
+ * Remove the cgroups created by launch_opts_prepare() whose jobs have all been reaped
+ * Cgroups that are still in use are kept and tried again on the next call
+ */
+void launch_cgroups_cleanup(void);
+
+/*
+ * Implements the ulimit builtin: "ulimit [-a | -c | -d | -f | -n | -s | -t | -u | -v] [LIMIT]"
+ * Limits are set on the shell itself, so every job started afterwards inherits them
+ * tokens: The builtin's tokens, starting with "ulimit"
+ * Returns 0 on success or -1 on error
+ */
+int set_resource_limit(strvec_t *tokens);
+
+#endif    // LAUNCH_H
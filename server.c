@@ -0,0 +1,231 @@
+#define _GNU_SOURCE
+
+#include "server.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/un.h>
+#include <unistd.h>
+
+#define LISTEN_BACKLOG 64
+#define NUM_STDIO_FDS 3
+
+int server_listen(const char *path) {
+    struct sockaddr_un addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(addr.sun_path)) {
+        fprintf(stderr, "Socket path too long\n");
+        return -1;
+    }
+    strcpy(addr.sun_path, path);
+
+    int fd;
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+        perror("socket");
+        return -1;
+    }
+
+    // A socket nobody is listening on is stale, but one that accepts connections is still in use
+    if (connect(fd, (struct sockaddr *) &addr, sizeof(addr)) == 0) {
+        fprintf(stderr, "A server is already listening on %s\n", path);
+        close(fd);
+        return -1;
+    }
+    int stale = errno == ECONNREFUSED;
+    close(fd);
+
+    // Only ever remove a socket, never a file that happens to have the same name
+    struct stat st;
+    if (stale && stat(path, &st) == 0 && S_ISSOCK(st.st_mode) && unlink(path) == -1) {
+        perror("unlink");
+        return -1;
+    }
+
+    if ((fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0)) == -1) {
+        perror("socket");
+        return -1;
+    }
+    // Whoever can connect can run commands as us, so the socket is created owner-only
+    mode_t old_umask = umask(S_IRWXG | S_IRWXO);
+    int bound = bind(fd, (struct sockaddr *) &addr, sizeof(addr));
+    umask(old_umask);
+    if (bound == -1) {
+        perror("bind");
+        close(fd);
+        return -1;
+    }
+    if (listen(fd, LISTEN_BACKLOG) == -1) {
+        perror("listen");
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int server_accept(int listen_fd) {
+    // Sessions are reaped automatically, so the server never has to wait on them
+    struct sigaction sac;
+    memset(&sac, 0, sizeof(sac));
+    sac.sa_handler = SIG_IGN;
+    if (sigaction(SIGCHLD, &sac, NULL) == -1) {
+        perror("sigaction");
+        return -1;
+    }
+
+    while (1) {
+        int conn_fd;
+        if ((conn_fd = accept4(listen_fd, NULL, NULL, SOCK_CLOEXEC)) == -1) {
+            if (errno == EINTR || errno == ECONNABORTED) {
+                continue;
+            }
+            perror("accept");
+            return -1;
+        }
+
+        // The socket's permissions should keep other users out, but don't rely on them alone
+        struct ucred cred;
+        socklen_t cred_len = sizeof(cred);
+        if (getsockopt(conn_fd, SOL_SOCKET, SO_PEERCRED, &cred, &cred_len) == -1) {
+            perror("getsockopt");
+            close(conn_fd);
+            continue;
+        }
+        if (cred.uid != geteuid()) {
+            fprintf(stderr, "Rejected client running as uid %d\n", (int) cred.uid);
+            close(conn_fd);
+            continue;
+        }
+
+        pid_t pid;
+        if ((pid = fork()) == -1) {
+            perror("fork");
+            close(conn_fd);
+            continue;
+        }
+
+        // Session process: it waits on its own jobs, so it needs SIGCHLD back
+        if (pid == 0) {
+            close(listen_fd);
+            sac.sa_handler = SIG_DFL;
+            if (sigaction(SIGCHLD, &sac, NULL) == -1) {
+                perror("sigaction");
+                return -1;
+            }
+            return conn_fd;
+        }
+        close(conn_fd);
+    }
+}
+
+/*
+ * Make fds passed by the client the session's stdin, stdout and stderr
+ * Returns 0 on success or -1 on error
+ */
+static int install_stdio(const int *fds) {
+    fflush(stdout);
+    fflush(stderr);
+    int ret = 0;
+    for (int i = 0; i < NUM_STDIO_FDS; i++) {
+        if (dup2(fds[i], i) == -1) {
+            perror("dup2");
+            ret = -1;
+        }
+    }
+    for (int i = 0; i < NUM_STDIO_FDS; i++) {
+        close(fds[i]);
+    }
+    return ret;
+}
+
+int server_read_batch(int conn_fd, char *batch, unsigned size, unsigned *batch_len) {
+    // The fds ride along with the length header, so they are received with it
+    uint32_t length;
+    struct iovec iov;
+    iov.iov_base = &length;
+    iov.iov_len = sizeof(length);
+    union {
+        char buf[CMSG_SPACE(NUM_STDIO_FDS * sizeof(int))];
+        struct cmsghdr align;
+    } control;
+    struct msghdr msg;
+    memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = &iov;
+    msg.msg_iovlen = 1;
+    msg.msg_control = control.buf;
+    msg.msg_controllen = sizeof(control.buf);
+
+    ssize_t n;
+    while ((n = recvmsg(conn_fd, &msg, MSG_WAITALL | MSG_CMSG_CLOEXEC)) == -1 && errno == EINTR) {
+    }
+    if (n == -1) {
+        perror("recvmsg");
+        return -1;
+    }
+    if (n == 0) {
+        return 0;
+    }
+    if (n != sizeof(length)) {
+        fprintf(stderr, "Truncated batch header\n");
+        return -1;
+    }
+
+    struct cmsghdr *cmsg = CMSG_FIRSTHDR(&msg);
+    if (cmsg != NULL && cmsg->cmsg_level == SOL_SOCKET && cmsg->cmsg_type == SCM_RIGHTS) {
+        // The control buffer only has room for three fds; the kernel closes any extras
+        int fds[NUM_STDIO_FDS];
+        unsigned num_fds = (cmsg->cmsg_len - CMSG_LEN(0)) / sizeof(int);
+        memcpy(fds, CMSG_DATA(cmsg), num_fds * sizeof(int));
+        if (num_fds != NUM_STDIO_FDS || (msg.msg_flags & MSG_CTRUNC)) {
+            fprintf(stderr, "Expected stdin, stdout and stderr with the batch\n");
+            for (unsigned i = 0; i < num_fds; i++) {
+                close(fds[i]);
+            }
+            return -1;
+        }
+        if (install_stdio(fds) == -1) {
+            return -1;
+        }
+    }
+
+    if (length > size) {
+        fprintf(stderr, "Batch of %u bytes is larger than %u\n", length, size);
+        return -1;
+    }
+    size_t received = 0;
+    while (received < length) {
+        if ((n = recv(conn_fd, batch + received, length - received, 0)) == -1) {
+            if (errno == EINTR) {
+                continue;
+            }
+            perror("recv");
+            return -1;
+        }
+        if (n == 0) {
+            fprintf(stderr, "Client hung up in the middle of a batch\n");
+            return -1;
+        }
+        received += n;
+    }
+    *batch_len = length;
+    return 1;
+}
+
+int server_send_status(int conn_fd, uint32_t command, int32_t status) {
+    server_status_t reply;
+    reply.command = command;
+    reply.status = status;
+
+    // A client that went away should end the session, not kill it with SIGPIPE
+    if (send(conn_fd, &reply, sizeof(reply), MSG_NOSIGNAL) != sizeof(reply)) {
+        perror("send");
+        return -1;
+    }
+    return 0;
+}
@@ -0,0 +1,64 @@
+#ifndef SERVER_H
+#define SERVER_H
+
+#include <stdint.h>
+
+#define SERVER_BATCH_LEN 65536
+#define SERVER_BATCH_END UINT32_MAX
+
+/*
+ * Wire protocol, with integers in host byte order since both ends share a machine
+ *
+ * Request: a uint32_t length followed by that many bytes of commands, one per line
+ *   Any request may carry exactly three fds with SCM_RIGHTS, which become the session's
+ *   stdin, stdout and stderr, so commands read and write the client's files directly
+ *   Until a client passes fds, its commands use the server's own stdio
+ *
+ * Reply: one server_status_t per command as soon as it finishes, then a final one
+ *   with command set to SERVER_BATCH_END and the status of the last command
+ *   An empty batch (e.g. one that only passes fds) gets just the final one, with status 0
+ */
+typedef struct {
+    uint32_t command;    // Index of the command within its batch
+    int32_t status;
+} server_status_t;
+
+/*
+ * Create a Unix socket listening for clients at a path
+ * The socket is only accessible to its owner
+ * A stale socket left at the path by an earlier server is replaced, but one that another
+ * server is still listening on is not
+ * path: Filesystem path to bind to
+ * Returns the listening socket on success or -1 on error
+ */
+int server_listen(const char *path);
+
+/*
+ * Accept clients forever, forking a session process for each one
+ * Clients running as a different user than the server are turned away
+ * Sessions start from the server's state (cwd, caches) but keep their own from then on
+ * listen_fd: Socket returned by server_listen()
+ * Returns the client's connection in each session process, or -1 in the server on error
+ */
+int server_accept(int listen_fd);
+
+/*
+ * Receive the next batch of commands from a client, installing any fds passed with it
+ * conn_fd: The client's connection
+ * batch: Buffer to copy the batch into (not NUL-terminated)
+ * size: Size of the batch buffer
+ * batch_len: Set to the length of the batch, which is 0 for a request that only passes fds
+ * Returns 1 if a batch was received, 0 once the client hung up, or -1 on error
+ */
+int server_read_batch(int conn_fd, char *batch, unsigned size, unsigned *batch_len);
+
+/*
+ * Report a command's exit status to a client
+ * conn_fd: The client's connection
+ * command: Index of the command within its batch, or SERVER_BATCH_END
+ * status: The command's exit status
+ * Returns 0 on success or -1 on error
+ */
+int server_send_status(int conn_fd, uint32_t command, int32_t status);
+
+#endif    // SERVER_H
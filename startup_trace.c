@@ -0,0 +1,103 @@
+#define _GNU_SOURCE
+
+#include "startup_trace.h"
+
+#include <stdio.h>
+#include <string.h>
+#include <sys/resource.h>
+#include <time.h>
+#include <unistd.h>
+
+#define MAX_STAGES 16
+
+typedef struct {
+    const char *name;
+    struct timespec time;
+} stage_t;
+
+static int enabled = 0;
+static struct timespec boot_at_main;
+static struct rusage usage_at_main;
+static stage_t stages[MAX_STAGES];
+static unsigned num_stages = 0;
+
+static double elapsed_ms(const struct timespec *from, const struct timespec *to) {
+    return (to->tv_sec - from->tv_sec) * 1e3 + (to->tv_nsec - from->tv_nsec) / 1e6;
+}
+
+void startup_trace_start(void) {
+    clock_gettime(CLOCK_BOOTTIME, &boot_at_main);
+    getrusage(RUSAGE_SELF, &usage_at_main);
+    num_stages = 0;
+    enabled = 1;
+    startup_trace_mark("main");
+}
+
+void startup_trace_mark(const char *stage) {
+    if (!enabled || num_stages == MAX_STAGES) {
+        return;
+    }
+    stages[num_stages].name = stage;
+    clock_gettime(CLOCK_MONOTONIC, &stages[num_stages].time);
+    num_stages++;
+}
+
+/*
+ * Find when this process was exec'd, in milliseconds since boot
+ * The kernel only keeps this at clock tick resolution (usually 10ms)
+ * Returns the start time, or -1 on error
+ */
+static double process_start_ms(void) {
+    FILE *f;
+    if ((f = fopen("/proc/self/stat", "r")) == NULL) {
+        return -1;
+    }
+    char buf[1024];
+    size_t n = fread(buf, 1, sizeof(buf) - 1, f);
+    fclose(f);
+    buf[n] = '\0';
+
+    // The command name may contain spaces, so start counting fields after its closing paren
+    char *field = strrchr(buf, ')');
+    if (field == NULL) {
+        return -1;
+    }
+    unsigned long long start_ticks;
+    if (sscanf(field + 2, "%*c %*d %*d %*d %*d %*d %*u %*u %*u %*u %*u %*u %*u %*d %*d %*d %*d "
+                          "%*d %*d %llu", &start_ticks) != 1) {
+        return -1;
+    }
+    return start_ticks * 1e3 / sysconf(_SC_CLK_TCK);
+}
+
+void startup_trace_report(void) {
+    if (!enabled) {
+        return;
+    }
+    startup_trace_mark("exec");
+    enabled = 0;
+
+    fprintf(stderr, "startup trace (pid %d):\n", getpid());
+
+    double start_ms = process_start_ms();
+    double main_ms = boot_at_main.tv_sec * 1e3 + boot_at_main.tv_nsec / 1e6;
+    double cpu_ms = (usage_at_main.ru_utime.tv_sec + usage_at_main.ru_stime.tv_sec) * 1e3 +
+                    (usage_at_main.ru_utime.tv_usec + usage_at_main.ru_stime.tv_usec) / 1e3;
+    if (start_ms >= 0) {
+        fprintf(stderr, "  %-12s %9.3f ms  (tick resolution; %.3f ms cpu)\n", "execve->main",
+                main_ms - start_ms, cpu_ms);
+    }
+
+    for (unsigned i = 1; i < num_stages; i++) {
+        fprintf(stderr, "  %-12s %9.3f ms\n", stages[i].name,
+                elapsed_ms(&stages[i - 1].time, &stages[i].time));
+    }
+    if (num_stages > 1) {
+        fprintf(stderr, "  %-12s %9.3f ms\n", "main->exec",
+                elapsed_ms(&stages[0].time, &stages[num_stages - 1].time));
+    }
+}
+
+void startup_trace_stop(void) {
+    enabled = 0;
+}
@@ -0,0 +1,28 @@
+#ifndef STARTUP_TRACE_H
+#define STARTUP_TRACE_H
+
+/*
+ * Start timing the shell's startup, for the --startup-trace flag
+ * Should be called as early in main() as possible
+ */
+void startup_trace_start(void);
+
+/*
+ * Record the end of a startup stage
+ * Does nothing unless startup_trace_start() was called
+ * stage: Short name for the stage that just finished (not copied, should be a literal)
+ */
+void startup_trace_mark(const char *stage);
+
+/*
+ * Print the timing breakdown to stderr and stop tracing
+ * Does nothing unless startup_trace_start() was called
+ */
+void startup_trace_report(void);
+
+/*
+ * Stop tracing without printing anything, e.g. in the shell once a child took over the report
+ */
+void startup_trace_stop(void);
+
+#endif    // STARTUP_TRACE_H
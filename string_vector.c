@@ -6,13 +6,10 @@
 #define INITIAL_SIZE 4
 
 int strvec_init(strvec_t *vec) {
+    // Storage is allocated by the first strvec_add(), so unused vectors cost nothing
     vec->length = 0;
-    vec->capacity = INITIAL_SIZE;
-    vec->data = malloc(INITIAL_SIZE * sizeof(char *));
-    if (vec->data == NULL) {
-        return -1;
-    }
-
+    vec->capacity = 0;
+    vec->data = NULL;
     return 0;
 }
 
@@ -20,21 +17,23 @@ void strvec_clear(strvec_t *vec) {
     if (vec->capacity == 0) {
         return;
     }
-    for (int i = 0; i < vec->length; i++) {
+    for (unsigned i = 0; i < vec->length; i++) {
         free(vec->data[i]);
     }
     free(vec->data);
 
+    vec->data = NULL;
     vec->length = 0;
     vec->capacity = 0;
 }
 
 int strvec_add(strvec_t *vec, const char *s) {
-    // If vector was previously cleared, need to reinitialize
+    // Vectors start out (and are left by strvec_clear()) without any storage
     if (vec->capacity == 0) {
-        if (strvec_init(vec) != 0) {
+        if ((vec->data = malloc(INITIAL_SIZE * sizeof(char *))) == NULL) {
             return -1;
         }
+        vec->capacity = INITIAL_SIZE;
     }
 
     if (vec->length == vec->capacity) {
@@ -48,10 +47,11 @@ int strvec_add(strvec_t *vec, const char *s) {
         vec->capacity = vec->capacity * 2;
     }
 
-    if ((vec->data[vec->length] = malloc((strlen(s) + 1) * sizeof(char))) == NULL) {
+    size_t len = strlen(s) + 1;
+    if ((vec->data[vec->length] = malloc(len * sizeof(char))) == NULL) {
         return -1;
     }
-    strcpy(vec->data[vec->length], s);
+    memcpy(vec->data[vec->length], s, len);
     vec->length++;
     return 0;
 }
@@ -65,7 +65,7 @@ char *strvec_get(const strvec_t *vec, unsigned i) {
 }
 
 int strvec_find(const strvec_t *vec, const char *s) {
-    for (int i = 0; i < vec->length; i++) {
+    for (unsigned i = 0; i < vec->length; i++) {
         if (strcmp(vec->data[i], s) == 0) {
             return i;
         }
@@ -78,8 +78,23 @@ void strvec_take(strvec_t *vec, unsigned n) {
         return;
     }
 
-    for (int i = n; i < vec->length; i++) {
+    for (unsigned i = n; i < vec->length; i++) {
         free(vec->data[i]);
     }
     vec->length = n;
 }
+
+void strvec_drop(strvec_t *vec, unsigned n) {
+    if (n > vec->length) {
+        n = vec->length;
+    }
+    if (n == 0) {
+        return;
+    }
+
+    for (unsigned i = 0; i < n; i++) {
+        free(vec->data[i]);
+    }
+    memmove(vec->data, vec->data + n, (vec->length - n) * sizeof(char *));
+    vec->length -= n;
+}
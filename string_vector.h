@@ -9,6 +9,7 @@ typedef struct {
 
 /*
  * Initializes a new, empty string vector
+ * No memory is allocated until the first string is added
  * vec: Pointer to the vector to initialize
  * Returns 0 on success, -1 on error
  */
@@ -18,7 +19,7 @@ int strvec_init(strvec_t *vec);
  * Removes all entries from a string vector
  * The underlying memory for the vector is also freed
  * vec: Pointer to the vector to clear
- * Note: You MUST re-initialize this vector with strvec_init() if you want to use it again
+ * Note: The vector is left empty and can be added to again without calling strvec_init()
  */
 void strvec_clear(strvec_t *vec);
 
@@ -54,4 +55,11 @@ int strvec_find(const strvec_t *vec, const char *s);
  */
 void strvec_take(strvec_t *vec, unsigned n);
 
+/*
+ * Modify a string vector so that its first 'n' elements are removed
+ * vec: Pointer to string vector to shorten
+ * n: Number of elements to remove from the front of the vector
+ */
+void strvec_drop(strvec_t *vec, unsigned n);
+
 #endif    // STRING_VECTOR_H
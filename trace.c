@@ -0,0 +1,241 @@
+#define _GNU_SOURCE
+
+#include "trace.h"
+
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "string_vector.h"
+
+#define TRACE_CAPACITY 4096    // Must be a power of two
+
+typedef struct {
+    _Atomic uint64_t seq;    // Index + 1 of the event in this slot, or 0 while it is being written
+    uint64_t ts_ns;
+    pid_t pid;
+    pid_t child;
+    int point;
+    int phase;
+} trace_slot_t;
+
+typedef struct {
+    _Atomic uint64_t head;
+    trace_slot_t slots[TRACE_CAPACITY];
+} trace_ring_t;
+
+static const char *point_names[] = {
+    [TRACE_PARSE] = "parse",
+    [TRACE_FORK] = "fork",
+    [TRACE_SETUP] = "setup",
+    [TRACE_EXEC] = "exec",
+    [TRACE_TCSETPGRP] = "tcsetpgrp",
+    [TRACE_WAIT] = "wait",
+    [TRACE_REAP] = "reap",
+};
+
+int trace_enabled = 0;
+
+// Shared with children so events recorded between fork and exec reach the shell
+static trace_ring_t *ring = NULL;
+
+static FILE *stream = NULL;
+static uint64_t stream_next = 0;
+static uint64_t stream_count = 0;
+
+void trace_record(trace_point_t point, trace_phase_t phase, pid_t child) {
+    uint64_t idx = atomic_fetch_add_explicit(&ring->head, 1, memory_order_relaxed);
+    trace_slot_t *slot = &ring->slots[idx & (TRACE_CAPACITY - 1)];
+
+    atomic_store_explicit(&slot->seq, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+    slot->ts_ns = now.tv_sec * 1000000000ULL + now.tv_nsec;
+    slot->pid = getpid();
+    slot->child = child;
+    slot->point = point;
+    slot->phase = phase;
+
+    atomic_store_explicit(&slot->seq, idx + 1, memory_order_release);
+}
+
+/*
+ * Copy out the event with a given index, if it is still in the buffer and fully written
+ * Returns 1 if the event was copied, 0 otherwise
+ */
+static int read_event(uint64_t idx, trace_slot_t *event) {
+    trace_slot_t *slot = &ring->slots[idx & (TRACE_CAPACITY - 1)];
+    if (atomic_load_explicit(&slot->seq, memory_order_acquire) != idx + 1) {
+        return 0;
+    }
+    event->ts_ns = slot->ts_ns;
+    event->pid = slot->pid;
+    event->child = slot->child;
+    event->point = slot->point;
+    event->phase = slot->phase;
+
+    // A writer that lapped us while we were copying will have changed seq
+    atomic_thread_fence(memory_order_acquire);
+    return atomic_load_explicit(&slot->seq, memory_order_relaxed) == idx + 1;
+}
+
+/*
+ * Returns the index of the oldest event that may still be in the buffer
+ */
+static uint64_t oldest_event(uint64_t head) {
+    return head > TRACE_CAPACITY ? head - TRACE_CAPACITY : 0;
+}
+
+static void write_event(FILE *f, const trace_slot_t *event) {
+    fprintf(f, "{\"name\":\"%s\",\"ph\":\"%c\",\"ts\":%.3f,\"pid\":%d,\"tid\":%d%s",
+            point_names[event->point], event->phase, event->ts_ns / 1e3, event->pid, event->pid,
+            event->phase == TRACE_INSTANT ? ",\"s\":\"p\"" : "");
+    // Lets a reap in the shell be matched up with the exec recorded under the child's pid
+    if (event->child != 0) {
+        fprintf(f, ",\"args\":{\"pid\":%d}", event->child);
+    }
+    fprintf(f, "}");
+}
+
+/*
+ * Map the ring buffer on first use
+ * Returns 0 on success or -1 on error
+ */
+static int trace_setup(void) {
+    if (ring != NULL) {
+        return 0;
+    }
+    ring = mmap(NULL, sizeof(trace_ring_t), PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS,
+                -1, 0);
+    if (ring == MAP_FAILED) {
+        perror("mmap");
+        ring = NULL;
+        return -1;
+    }
+    return 0;
+}
+
+void trace_flush(void) {
+    if (stream == NULL) {
+        return;
+    }
+
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    if (stream_next < oldest_event(head)) {
+        fprintf(stderr, "trace: %llu events were overwritten before they could be written\n",
+                (unsigned long long) (oldest_event(head) - stream_next));
+        stream_next = oldest_event(head);
+    }
+
+    for (; stream_next < head; stream_next++) {
+        trace_slot_t event;
+        if (read_event(stream_next, &event)) {
+            fprintf(stream, "%s", stream_count++ == 0 ? "" : ",\n");
+            write_event(stream, &event);
+        }
+    }
+    fflush(stream);
+}
+
+/*
+ * Write every event still in the buffer as a Chrome trace JSON object
+ * Returns 0 on success or -1 on error
+ */
+static int trace_dump(const char *file_name) {
+    FILE *f = stdout;
+    if (file_name != NULL && (f = fopen(file_name, "w")) == NULL) {
+        perror("Failed to open trace file");
+        return -1;
+    }
+
+    fprintf(f, "{\"traceEvents\":[\n");
+    uint64_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    int first = 1;
+    for (uint64_t i = oldest_event(head); i < head; i++) {
+        trace_slot_t event;
+        if (read_event(i, &event)) {
+            fprintf(f, "%s", first ? "" : ",\n");
+            write_event(f, &event);
+            first = 0;
+        }
+    }
+    fprintf(f, "\n]}\n");
+
+    if (f == stdout) {
+        fflush(f);
+    } else if (fclose(f) == EOF) {
+        perror("fclose");
+        return -1;
+    }
+    return 0;
+}
+
+/*
+ * Stream events to a file in the Chrome JSON array format, or stop streaming if file_name is NULL
+ * Returns 0 on success or -1 on error
+ */
+static int trace_stream(const char *file_name) {
+    if (stream != NULL) {
+        trace_flush();
+        fprintf(stream, "\n]\n");
+        if (fclose(stream) == EOF) {
+            perror("fclose");
+        }
+        stream = NULL;
+    }
+    if (file_name == NULL) {
+        return 0;
+    }
+
+    if ((stream = fopen(file_name, "w")) == NULL) {
+        perror("Failed to open trace file");
+        return -1;
+    }
+    // The array format tolerates a missing ']' if the shell dies before closing it
+    fprintf(stream, "[\n");
+    stream_next = atomic_load_explicit(&ring->head, memory_order_acquire);
+    stream_count = 0;
+    trace_enabled = 1;
+    return 0;
+}
+
+void trace_close(void) {
+    trace_stream(NULL);
+}
+
+int trace_command(strvec_t *tokens) {
+    const char *action = strvec_get(tokens, 1);
+    const char *file_name = strvec_get(tokens, 2);
+    if (action == NULL) {
+        printf("tracing is %s\n", trace_enabled ? "on" : "off");
+        return 0;
+    }
+    if (trace_setup() == -1) {
+        return -1;
+    }
+
+    if (strcmp(action, "on") == 0) {
+        trace_enabled = 1;
+    } else if (strcmp(action, "off") == 0) {
+        trace_enabled = 0;
+    } else if (strcmp(action, "clear") == 0) {
+        trace_flush();
+        memset(ring, 0, sizeof(trace_ring_t));
+        stream_next = 0;
+    } else if (strcmp(action, "dump") == 0) {
+        return trace_dump(file_name);
+    } else if (strcmp(action, "file") == 0) {
+        return trace_stream(file_name);
+    } else {
+        fprintf(stderr, "Usage: trace [on | off | clear | dump [FILE] | file [FILE]]\n");
+        return -1;
+    }
+    return 0;
+}
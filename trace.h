@@ -0,0 +1,74 @@
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <sys/types.h>
+
+#include "string_vector.h"
+
+typedef enum {
+    TRACE_PARSE,
+    TRACE_FORK,
+    TRACE_SETUP,
+    TRACE_EXEC,
+    TRACE_TCSETPGRP,
+    TRACE_WAIT,
+    TRACE_REAP,
+} trace_point_t;
+
+// Phases use the Chrome trace event letters
+typedef enum {
+    TRACE_BEGIN = 'B',
+    TRACE_END = 'E',
+    TRACE_INSTANT = 'i',
+} trace_phase_t;
+
+extern int trace_enabled;
+
+/*
+ * Record an event at one of the shell's instrumentation points
+ * Costs a single predictable branch while tracing is off
+ */
+#define TRACE(point, phase) TRACE_CHILD((point), (phase), 0)
+
+/*
+ * Record an event about a particular child, such as the reap of a job
+ */
+#define TRACE_CHILD(point, phase, child)                 \
+    do {                                                 \
+        if (__builtin_expect(trace_enabled, 0)) {        \
+            trace_record((point), (phase), (child));     \
+        }                                                \
+    } while (0)
+
+/*
+ * Append an event to the trace ring buffer, overwriting the oldest event once full
+ * Safe to call concurrently from the shell and its forked children, which share the buffer
+ * point: Where in a command's lifecycle the event happened
+ * phase: Whether the event begins or ends a span, or is a single instant
+ * child: The process the event is about (emitted as args.pid), or 0 if none
+ */
+void trace_record(trace_point_t point, trace_phase_t phase, pid_t child);
+
+/*
+ * Write any events recorded since the last flush to the file set with "trace file"
+ * Does nothing if no trace file is open
+ */
+void trace_flush(void);
+
+/*
+ * Write any remaining events to the file set with "trace file" and close it
+ * Does nothing if no trace file is open
+ */
+void trace_close(void);
+
+/*
+ * Implements the trace builtin:
+ * "trace on|off|clear", "trace dump [FILE]" or "trace file [FILE]"
+ * Dumps use the Chrome trace JSON format, and "trace file" streams events to FILE
+ * at every prompt until it is called again without a file
+ * tokens: The builtin's tokens, starting with "trace"
+ * Returns 0 on success or -1 on error
+ */
+int trace_command(strvec_t *tokens);
+
+#endif    // TRACE_H